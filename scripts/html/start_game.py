@@ -7,6 +7,11 @@ import time
 
 max_clients = 8
 
+# Each node runs "cloudtari /var/run/cloudtari frontdoor 8080", which
+# passes /gameN/ to the game listening on /var/run/cloudtari/gameN.sock.
+socket_directory = "/var/run/cloudtari"
+front_door_port = 8080
+
 def remove_completed(data):
   terminated = 0
 
@@ -19,9 +24,9 @@ def remove_completed(data):
     state = container_status["state"]
     pod_name = item["metadata"]["name"]
     job_name = item["metadata"]["labels"]["job-name"]
-    port = item["spec"]["containers"][0]["command"][3]
+    name = get_name(item)
 
-    print("port=" + port)
+    print("name=" + name)
 
     if "terminated" in state:
       os.system("microk8s.kubectl delete pod " + pod_name)
@@ -31,22 +36,24 @@ def remove_completed(data):
 
   return terminated
 
-def get_next_port(data):
-  port = 8080
+def get_name(item):
+  path = item["spec"]["containers"][0]["command"][3]
+
+  return os.path.basename(path).replace(".sock", "")
 
-  ports = []
+def get_next_name(data):
+  names = []
 
   for item in data["items"]:
-    ports.append(int(item["spec"]["containers"][0]["command"][3]))
+    names.append(get_name(item))
+
+  n = 1
 
-  while True:
-    if port not in ports: break
-    port += 1
-    if port == 9000: return 0
+  while "game" + str(n) in names: n += 1
 
-  return port
+  return "game" + str(n)
 
-def start_job(rom, port):
+def start_job(rom, name):
   yaml = """apiVersion: batch/v1
 kind: Job
 metadata:
@@ -60,13 +67,20 @@ spec:
       - name: cloudtari
         image: localhost:32000/cloudtari:local
         imagePullPolicy: Always
-        command: ["/root/cloudtari", "/root/ROM", "http", "PORT"]
-      hostNetwork: true
+        command: ["/root/cloudtari", "/root/ROM", "http", "SOCKETS/NAME.sock"]
+        volumeMounts:
+        - name: sockets
+          mountPath: SOCKETS
+      volumes:
+      - name: sockets
+        hostPath:
+          path: SOCKETS
       restartPolicy: Never
 """
 
-  yaml = yaml.replace("META", str(port))
-  yaml = yaml.replace("PORT", str(port))
+  yaml = yaml.replace("META", name)
+  yaml = yaml.replace("NAME", name)
+  yaml = yaml.replace("SOCKETS", socket_directory)
   yaml = yaml.replace("ROM", rom)
 
   #print(yaml)
@@ -77,12 +91,12 @@ spec:
 
   os.system("microk8s.kubectl apply -f /tmp/cloudtari.yaml")
 
-def get_address(data, port):
+def get_address(data, name):
   for item in data["items"]:
-    if int(item["spec"]["containers"][0]["command"][3]) == port:
+    if get_name(item) == name:
       host_ip = item["status"]["hostIP"]
-      print(str(port) + " " + item["status"]["hostIP"])
-      return host_ip + ":" + str(port)
+      print(name + " " + item["status"]["hostIP"])
+      return host_ip + ":" + str(front_door_port) + "/" + name
 
   return "problem:0"
 
@@ -110,11 +124,11 @@ print("current_clients=" + str(current_clients))
 
 # This part assumes the PHP script is locked so only one process can
 # call this script.
-port = get_next_port(data)
+name = get_next_name(data)
 
-print("port=" + str(port))
+print("name=" + name)
 
-start_job(rom, port)
+start_job(rom, name)
 
 # Need to pause so the job is done being created.
 time.sleep(3)
@@ -122,7 +136,7 @@ time.sleep(3)
 result = subprocess.run(['microk8s.kubectl', 'get', 'pods', '-o', 'json'], stdout=subprocess.PIPE)
 data = json.loads(result.stdout)
 
-address = get_address(data, port)
+address = get_address(data, name)
 
 print("address=" + address)
 
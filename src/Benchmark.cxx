@@ -0,0 +1,388 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "Benchmark.h"
+#include "ColorTable.h"
+#include "FrameHash.h"
+#include "GifCompressor.h"
+#include "ImageScaler.h"
+#include "Machine.h"
+#include "RleCompressor.h"
+#include "SaveState.h"
+
+void Benchmark::run_machine(M6502 *m6502, MemoryBus *memory_bus, int seconds)
+{
+  run("machine", m6502, memory_bus, seconds);
+}
+
+void Benchmark::run_reference(M6502 *m6502, MemoryBus *memory_bus, int seconds)
+{
+  // Same as run_machine() but with the TIA drawing one pixel at a time.
+  TIA *tia = memory_bus->get_tia();
+
+  tia->set_reference_renderer(true);
+  run("reference", m6502, memory_bus, seconds);
+  tia->set_reference_renderer(false);
+}
+
+void Benchmark::run(
+  const char *name,
+  M6502 *m6502,
+  MemoryBus *memory_bus,
+  int seconds)
+{
+  // Same loop as cloudtari.cxx running in "null" mode. The TIA and RIOT
+  // are caught up by the MemoryBus as they are accessed.
+  const uint64_t start_cycles = m6502->get_total_cycles();
+  const double start = get_time();
+  double now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 65536; n++)
+    {
+      m6502->step();
+    }
+
+    now = get_time();
+  }
+
+  print_result(name, m6502->get_total_cycles() - start_cycles, now - start);
+  m6502->dump_cache_stats();
+}
+
+void Benchmark::run_save_state(
+  M6502 *m6502,
+  MemoryBus *memory_bus,
+  int seconds)
+{
+  // Saving and restoring the game where it is, so it keeps going from
+  // the same place afterward.
+  SaveState::Image image;
+  uint64_t saves = 0;
+  uint64_t restores = 0;
+  double start = get_time();
+  double now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 65536; n++)
+    {
+      SaveState::save(m6502, memory_bus, image);
+    }
+
+    saves += 65536;
+    now = get_time();
+  }
+
+  const double save_time = (now - start) / saves;
+
+  start = get_time();
+  now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 65536; n++)
+    {
+      SaveState::restore(m6502, memory_bus, image);
+    }
+
+    restores += 65536;
+    now = get_time();
+  }
+
+  const double restore_time = (now - start) / restores;
+
+  printf("save state: %.0f ns, restore %.0f ns (%d bytes)\n",
+    save_time * 1000000000,
+    restore_time * 1000000000,
+    (int)sizeof(image));
+}
+
+void Benchmark::run_clones(const char *filename, int seconds)
+{
+  // A Machine used like a tree search would: branching a saved state
+  // into other slots, and going back to a saved state to run a frame
+  // from it.
+  Machine machine;
+  const int pool_size = 1024;
+  uint64_t clones = 0;
+  uint64_t resets = 0;
+
+  if (machine.init(filename, pool_size) != 0) { return; }
+
+  machine.run_frame();
+  machine.save(0);
+
+  double start = get_time();
+  double now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 65536; n++)
+    {
+      machine.clone((n % (pool_size - 1)) + 1, 0);
+    }
+
+    clones += 65536;
+    now = get_time();
+  }
+
+  const double clone_rate = clones / (now - start);
+
+  start = get_time();
+  now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 64; n++)
+    {
+      machine.restore(n % pool_size);
+      machine.run_frame();
+    }
+
+    resets += 64;
+    now = get_time();
+  }
+
+  printf("clone: %.2f M/s, restore and run a frame: %.0f/s\n",
+    clone_rate / 1000000,
+    resets / (now - start));
+}
+
+void Benchmark::run_scale(int seconds)
+{
+  // Converting a 160x192 frame to 32 bit pixels at each scale, with the
+  // vector kernel and the plain C++ one.
+  const int width = Television::FRAME_WIDTH;
+  const int height = Television::FRAME_HEIGHT;
+  uint8_t *frame = (uint8_t *)malloc(width * height);
+  uint32_t *image = (uint32_t *)malloc(width * 3 * height * 2 * 4);
+
+  for (int n = 0; n < width * height; n++) { frame[n] = (n * 7) & 0x7f; }
+
+  for (int scale = 1; scale <= 3; scale++)
+  {
+    const double simd = time_scale(frame, image, scale, false, seconds);
+    const double scalar = time_scale(frame, image, scale, true, seconds);
+
+    printf("scale %dx: %.0f frames/s (scalar %.0f frames/s, %.1fx)\n",
+      scale, simd, scalar, simd / scalar);
+  }
+
+  free(frame);
+  free(image);
+}
+
+double Benchmark::time_scale(
+  const uint8_t *frame,
+  uint32_t *image,
+  int scale,
+  bool scalar,
+  int seconds)
+{
+  const int width = Television::FRAME_WIDTH;
+  const int height = Television::FRAME_HEIGHT;
+  const int scale_y = scale == 1 ? 1 : 2;
+  const double start = get_time();
+  double now = start;
+  int frames = 0;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 100; n++)
+    {
+      if (scalar)
+      {
+        // Same as ImageScaler::scale_image() with the scalar kernel.
+        for (int y = 0; y < height; y++)
+        {
+          uint32_t *row = image + (y * scale_y * width * scale);
+
+          ImageScaler::scale_line_scalar(row, frame + (y * width), width, scale);
+
+          if (scale_y == 2)
+          {
+            memcpy(row + (width * scale), row, width * scale * 4);
+          }
+        }
+      }
+        else
+      {
+        ImageScaler::scale_image(image, frame, width, height, scale, scale_y);
+      }
+    }
+
+    frames += 100;
+    now = get_time();
+  }
+
+  return frames / (now - start);
+}
+
+void Benchmark::run_gif(Television *television, int seconds)
+{
+  // Compress the last frame the game drew the same way TelevisionHttp
+  // does, at the native size and scaled up to 480x384.
+  const int width = Television::FRAME_WIDTH;
+  const int height = Television::FRAME_HEIGHT;
+  uint8_t *frame = television->get_frame();
+  uint8_t *large = (uint8_t *)malloc(width * 3 * height * 2);
+
+  for (int y = 0; y < height * 2; y++)
+  {
+    for (int x = 0; x < width * 3; x++)
+    {
+      large[(y * width * 3) + x] = frame[((y / 2) * width) + (x / 3)];
+    }
+  }
+
+  printf("gif %dx%d: %.0f frames/s\n",
+    width, height, time_gif(frame, width, height, seconds));
+  printf("gif %dx%d: %.0f frames/s\n",
+    width * 3, height * 2, time_gif(large, width * 3, height * 2, seconds));
+  printf("rle %dx%d: %.0f frames/s\n",
+    width, height, time_rle(frame, width, height, seconds));
+
+  free(large);
+}
+
+double Benchmark::time_gif(uint8_t *frame, int width, int height, int seconds)
+{
+  GifCompressor gif_compressor;
+  const double start = get_time();
+  double now = start;
+  int frames = 0;
+
+  gif_compressor.set_width(width);
+  gif_compressor.set_height(height);
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 100; n++)
+    {
+      gif_compressor.compress(frame, ColorTable::get_table());
+    }
+
+    frames += 100;
+    now = get_time();
+  }
+
+  return frames / (now - start);
+}
+
+double Benchmark::time_rle(uint8_t *frame, int width, int height, int seconds)
+{
+  // Every frame is compressed whole, the same as the first frame sent
+  // on a WebSocket, to compare with the GIF time.
+  RleCompressor rle_compressor;
+  const double start = get_time();
+  double now = start;
+  int frames = 0;
+
+  rle_compressor.set_width(width);
+  rle_compressor.set_height(height);
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 100; n++)
+    {
+      rle_compressor.compress(frame, nullptr);
+    }
+
+    frames += 100;
+    now = get_time();
+  }
+
+  return frames / (now - start);
+}
+
+void Benchmark::run_hash(int seconds)
+{
+  // Hashing a 160x192 frame, and checking that the vector version gives
+  // the same hash as the plain C++ one and that moving a sprite down two
+  // lines changes the hash.
+  const int width = Television::FRAME_WIDTH;
+  const int height = Television::FRAME_HEIGHT;
+  uint8_t *frame = (uint8_t *)malloc(width * height);
+  uint8_t *moved = (uint8_t *)malloc(width * height);
+  uint64_t frames = 0;
+  uint64_t hash = 0;
+
+  memset(frame, 0x10, width * height);
+  memset(moved, 0x10, width * height);
+
+  for (int y = 0; y < 8; y++)
+  {
+    memset(frame + ((10 + y) * width) + 40, 0x44, 4);
+    memset(moved + ((12 + y) * width) + 40, 0x44, 4);
+  }
+
+  const uint64_t hash_frame = FrameHash::compute(frame, width * height);
+  const uint64_t hash_moved = FrameHash::compute(moved, width * height);
+
+  if (hash_frame != FrameHash::compute_scalar(frame, width * height) ||
+      hash_moved != FrameHash::compute_scalar(moved, width * height))
+  {
+    printf("Error: FrameHash vector and scalar hashes don't match.\n");
+  }
+
+  if (hash_frame == hash_moved)
+  {
+    printf("Error: FrameHash doesn't see a sprite move.\n");
+  }
+
+  const double start = get_time();
+  double now = start;
+
+  while (now - start < seconds)
+  {
+    for (int n = 0; n < 1000; n++)
+    {
+      hash += FrameHash::compute(frame, width * height);
+    }
+
+    frames += 1000;
+    now = get_time();
+  }
+
+  printf("hash 160x192: %.0f frames/s (%016" PRIx64 ")\n",
+    frames / (now - start), hash);
+
+  free(frame);
+  free(moved);
+}
+
+double Benchmark::get_time()
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return tp.tv_sec + ((double)tp.tv_nsec / 1000000000);
+}
+
+void Benchmark::print_result(const char *name, uint64_t cycles, double seconds)
+{
+  const double cycles_per_second = cycles / seconds;
+
+  printf("%8s: %.2f Mcycles/s (%.1fx real time)\n",
+    name,
+    cycles_per_second / 1000000,
+    cycles_per_second / CPU_HZ);
+}
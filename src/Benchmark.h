@@ -0,0 +1,63 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * Benchmark is used by the "benchmark" command line option to measure
+ * how fast parts of the emulator run compared to a real Atari 2600.
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "M6502.h"
+#include "MemoryBus.h"
+#include "Television.h"
+
+class Benchmark
+{
+public:
+  static void run_machine(M6502 *m6502, MemoryBus *memory_bus, int seconds);
+  static void run_reference(M6502 *m6502, MemoryBus *memory_bus, int seconds);
+  static void run_save_state(
+    M6502 *m6502,
+    MemoryBus *memory_bus,
+    int seconds);
+  static void run_clones(const char *filename, int seconds);
+  static void run_scale(int seconds);
+  static void run_hash(int seconds);
+  static void run_gif(Television *television, int seconds);
+
+private:
+  Benchmark() { }
+  ~Benchmark() { }
+
+  static void run(
+    const char *name,
+    M6502 *m6502,
+    MemoryBus *memory_bus,
+    int seconds);
+
+  static double time_scale(
+    const uint8_t *frame,
+    uint32_t *image,
+    int scale,
+    bool scalar,
+    int seconds);
+
+  static double time_gif(uint8_t *frame, int width, int height, int seconds);
+  static double time_rle(uint8_t *frame, int width, int height, int seconds);
+
+  static double get_time();
+  static void print_result(const char *name, uint64_t cycles, double seconds);
+
+  // NTSC 6507 clock.
+  static constexpr double CPU_HZ = 1193182.0;
+};
+
+#endif
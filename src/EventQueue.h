@@ -0,0 +1,65 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * EventQueue passes Television::KEY_ events from a network thread to
+ * the emulator thread. It's a ring buffer for exactly one thread
+ * pushing and one thread popping, so it only needs the two atomic
+ * indexes and never locks.
+ *
+ */
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+class EventQueue
+{
+public:
+  EventQueue() : head{0}, tail{0} { }
+  ~EventQueue() { }
+
+  // Returns false if the queue is full and the event was dropped.
+  bool push(int event)
+  {
+    const int next = (tail.load(std::memory_order_relaxed) + 1) & MASK;
+
+    if (next == head.load(std::memory_order_acquire)) { return false; }
+
+    events[tail.load(std::memory_order_relaxed)] = event;
+    tail.store(next, std::memory_order_release);
+
+    return true;
+  }
+
+  // Returns 0 if there are no events.
+  int pop()
+  {
+    const int current = head.load(std::memory_order_relaxed);
+
+    if (current == tail.load(std::memory_order_acquire)) { return 0; }
+
+    const int event = events[current];
+    head.store((current + 1) & MASK, std::memory_order_release);
+
+    return event;
+  }
+
+private:
+  static const int SIZE = 256;
+  static const int MASK = SIZE - 1;
+
+  int events[SIZE];
+  std::atomic<int> head;
+  std::atomic<int> tail;
+};
+
+#endif
+
@@ -0,0 +1,178 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "FrameHash.h"
+
+const uint64_t FrameHash::keys[8] =
+{
+  0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL,
+  0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+  0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL,
+  0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+uint64_t FrameHash::compute(const uint8_t *data, int length)
+{
+#if defined(__AVX2__)
+  uint64_t accumulators[8];
+
+  for (int n = 0; n < 8; n++)
+  {
+    accumulators[n] = keys[7 - n];
+  }
+
+  __m256i sum_0 = _mm256_loadu_si256((const __m256i *)(accumulators + 0));
+  __m256i sum_1 = _mm256_loadu_si256((const __m256i *)(accumulators + 4));
+  __m256i key_0 = _mm256_loadu_si256((const __m256i *)(keys + 0));
+  __m256i key_1 = _mm256_loadu_si256((const __m256i *)(keys + 4));
+  const __m256i key_step = _mm256_set1_epi64x(KEY_STEP);
+  int ptr;
+
+  for (ptr = 0; ptr + 64 <= length; ptr += 64)
+  {
+    const __m256i value_0 = _mm256_loadu_si256((const __m256i *)(data + ptr));
+    const __m256i value_1 =
+      _mm256_loadu_si256((const __m256i *)(data + ptr + 32));
+    const __m256i mixed_0 = _mm256_xor_si256(value_0, key_0);
+    const __m256i mixed_1 = _mm256_xor_si256(value_1, key_1);
+
+    // Each 64 bit lane gets the value of the lane next to it added in.
+    sum_0 = _mm256_add_epi64(sum_0,
+      _mm256_shuffle_epi32(value_0, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum_1 = _mm256_add_epi64(sum_1,
+      _mm256_shuffle_epi32(value_1, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum_0 = _mm256_add_epi64(sum_0,
+      _mm256_mul_epu32(mixed_0, _mm256_srli_epi64(mixed_0, 32)));
+    sum_1 = _mm256_add_epi64(sum_1,
+      _mm256_mul_epu32(mixed_1, _mm256_srli_epi64(mixed_1, 32)));
+
+    key_0 = _mm256_add_epi64(key_0, key_step);
+    key_1 = _mm256_add_epi64(key_1, key_step);
+  }
+
+  _mm256_storeu_si256((__m256i *)(accumulators + 0), sum_0);
+  _mm256_storeu_si256((__m256i *)(accumulators + 4), sum_1);
+
+  return finish(accumulators, data + ptr, length - ptr, length);
+#elif defined(__SSE2__)
+  uint64_t accumulators[8];
+  __m128i sum[4];
+  __m128i key[4];
+  const __m128i key_step = _mm_set1_epi64x(KEY_STEP);
+  int ptr;
+
+  for (int n = 0; n < 8; n++)
+  {
+    accumulators[n] = keys[7 - n];
+  }
+
+  for (int n = 0; n < 4; n++)
+  {
+    sum[n] = _mm_loadu_si128((const __m128i *)(accumulators + (n * 2)));
+    key[n] = _mm_loadu_si128((const __m128i *)(keys + (n * 2)));
+  }
+
+  for (ptr = 0; ptr + 64 <= length; ptr += 64)
+  {
+    for (int n = 0; n < 4; n++)
+    {
+      const __m128i value =
+        _mm_loadu_si128((const __m128i *)(data + ptr + (n * 16)));
+      const __m128i mixed = _mm_xor_si128(value, key[n]);
+
+      sum[n] = _mm_add_epi64(sum[n],
+        _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)));
+      sum[n] = _mm_add_epi64(sum[n],
+        _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32)));
+
+      key[n] = _mm_add_epi64(key[n], key_step);
+    }
+  }
+
+  for (int n = 0; n < 4; n++)
+  {
+    _mm_storeu_si128((__m128i *)(accumulators + (n * 2)), sum[n]);
+  }
+
+  return finish(accumulators, data + ptr, length - ptr, length);
+#else
+  return compute_scalar(data, length);
+#endif
+}
+
+uint64_t FrameHash::compute_scalar(const uint8_t *data, int length)
+{
+  uint64_t accumulators[8];
+  uint64_t key_offset = 0;
+  int ptr;
+
+  for (int n = 0; n < 8; n++)
+  {
+    accumulators[n] = keys[7 - n];
+  }
+
+  for (ptr = 0; ptr + 64 <= length; ptr += 64)
+  {
+    for (int n = 0; n < 8; n++)
+    {
+      uint64_t value;
+
+      memcpy(&value, data + ptr + (n * 8), 8);
+
+      const uint64_t mixed = value ^ (keys[n] + key_offset);
+
+      accumulators[n ^ 1] += value;
+      accumulators[n] += (mixed & 0xffffffff) * (mixed >> 32);
+    }
+
+    key_offset += KEY_STEP;
+  }
+
+  return finish(accumulators, data + ptr, length - ptr, length);
+}
+
+uint64_t FrameHash::finish(
+  const uint64_t *accumulators,
+  const uint8_t *tail,
+  int tail_length,
+  int length)
+{
+  uint64_t hash = length * 0x9e3779b185ebca87ULL;
+
+  for (int n = 0; n < 8; n++)
+  {
+    hash = (hash ^ accumulators[n]) * 0xc2b2ae3d27d4eb4fULL;
+    hash ^= hash >> 31;
+  }
+
+  for (int n = 0; n < tail_length; n++)
+  {
+    hash = (hash ^ tail[n]) * 0x100000001b3ULL;
+  }
+
+  hash ^= hash >> 37;
+  hash *= 0x165667919e3779f9ULL;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
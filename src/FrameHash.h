@@ -0,0 +1,51 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * FrameHash is a fast 64 bit hash for telling if a frame is the same as
+ * the last one without keeping a copy to compare with. It works like the
+ * xxHash XXH3 inner loop: 8 64 bit accumulators each add the product of
+ * the low and high halves of their data mixed with a key, 64 bytes at a
+ * time. Like XXH3 moving along its secret, the keys change every 64
+ * bytes, so the same bytes in another place in the frame (a sprite that
+ * moved down a few lines) change the hash. With SSE2 or AVX2 the
+ * accumulators are in vector registers. The result is the same either
+ * way, but it's not the same as real XXH3.
+ *
+ */
+
+#ifndef FRAME_HASH_H
+#define FRAME_HASH_H
+
+#include <stdint.h>
+
+class FrameHash
+{
+public:
+  static uint64_t compute(const uint8_t *data, int length);
+  static uint64_t compute_scalar(const uint8_t *data, int length);
+
+private:
+  FrameHash() { }
+  ~FrameHash() { }
+
+  static uint64_t finish(
+    const uint64_t *accumulators,
+    const uint8_t *tail,
+    int tail_length,
+    int length);
+
+  static const uint64_t keys[8];
+
+  // Added to the keys after each 64 bytes, so the same 64 bytes hash
+  // differently depending on where they are.
+  static const uint64_t KEY_STEP = 0x9e3779b97f4a7c15ULL;
+};
+
+#endif
+
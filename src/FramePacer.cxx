@@ -0,0 +1,179 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+
+#include "FramePacer.h"
+
+FramePacer::FramePacer() :
+  period{0},
+  spin{0},
+  deadline{0},
+  last_frame{0}
+{
+  set_rate(NTSC_HZ);
+  reset();
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+void FramePacer::set_rate(double hz)
+{
+  period = (int64_t)(1000000000.0 / hz);
+}
+
+void FramePacer::reset()
+{
+  deadline = 0;
+  last_frame = 0;
+  frames = 0;
+  late_frames = 0;
+  resyncs = 0;
+  max_late = 0;
+  intervals = 0;
+  mean = 0;
+  m2 = 0;
+  min_interval = 0;
+  max_interval = 0;
+}
+
+void FramePacer::wait()
+{
+  int64_t now = get_time();
+
+  if (advance(now))
+  {
+    const int64_t wake = deadline - spin;
+    struct timespec ts;
+
+    ts.tv_sec = wake / 1000000000;
+    ts.tv_nsec = wake % 1000000000;
+
+    while (true)
+    {
+      int n = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+      if (n != EINTR) { break; }
+    }
+
+    now = get_time();
+
+    while (now < deadline) { now = get_time(); }
+  }
+
+  count_frame(now);
+}
+
+int64_t FramePacer::next_deadline()
+{
+  const int64_t now = get_time();
+
+  advance(now);
+  count_frame(now);
+
+  return deadline;
+}
+
+bool FramePacer::advance(int64_t now)
+{
+  // Moves the deadline to the next frame. Returns false if it's already
+  // past it.
+  if (deadline == 0) { deadline = now; }
+
+  deadline += period;
+
+  if (now <= deadline) { return true; }
+
+  late_frames++;
+
+  if (now - deadline > max_late) { max_late = now - deadline; }
+
+  if (now - deadline > period * MAX_BEHIND)
+  {
+    resyncs++;
+    deadline = now;
+  }
+
+  return false;
+}
+
+void FramePacer::count_frame(int64_t now)
+{
+  frames++;
+
+  if (last_frame != 0)
+  {
+    const double interval = (now - last_frame) / 1000.0;
+    const double delta = interval - mean;
+
+    intervals++;
+    mean += delta / intervals;
+    m2 += delta * (interval - mean);
+
+    if (intervals == 1 || interval < min_interval)
+    {
+      min_interval = interval;
+    }
+
+    if (intervals == 1 || interval > max_interval)
+    {
+      max_interval = interval;
+    }
+  }
+
+  last_frame = now;
+}
+
+double FramePacer::get_jitter_us()
+{
+  if (intervals < 2) { return 0; }
+
+  return sqrt(m2 / (intervals - 1));
+}
+
+void FramePacer::print_stats()
+{
+  if (frames == 0) { return; }
+
+  printf(" frame pacing: %" PRId64 " frames at %.3f Hz\n",
+    frames, 1000000000.0 / period);
+
+  if (intervals != 0)
+  {
+    printf("     interval: mean=%.1fus jitter=%.1fus\n",
+      mean, get_jitter_us());
+    printf("               min=%.1fus max=%.1fus\n",
+      min_interval, max_interval);
+  }
+
+  printf("         late: %" PRId64 " (%.2f%%) worst=%.1fus\n",
+    late_frames,
+    (double)late_frames * 100 / frames,
+    max_late / 1000.0);
+  printf("      resyncs: %" PRId64 "\n", resyncs);
+}
+
+int64_t FramePacer::get_time()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
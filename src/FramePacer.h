@@ -0,0 +1,85 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * FramePacer keeps the emulator running at the speed of a real TV. Each
+ * frame gets an absolute CLOCK_MONOTONIC deadline one period after the
+ * last one, and wait() sleeps until it with clock_nanosleep(), so a slow
+ * frame is made up on the next ones instead of adding to every frame
+ * after it. If the emulator falls more than MAX_BEHIND frames behind
+ * (stopped in a debugger, machine swapping), it starts over from now
+ * instead of running as fast as it can to catch up.
+ *
+ * The sleep can wake up late by tens of microseconds, so set_spin() can
+ * have it sleep until a little before the deadline and busy wait for
+ * the rest.
+ *
+ * It also keeps the time between frames and counts frames that were
+ * already late when wait() was called, for print_stats().
+ *
+ * next_deadline() is wait() without the sleep, for a SessionServer
+ * worker that has other sessions to run until this one is due.
+ *
+ */
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdint.h>
+
+class FramePacer
+{
+public:
+  FramePacer();
+  ~FramePacer();
+
+  void set_rate(double hz);
+  void set_spin(int us) { spin = (int64_t)us * 1000; }
+  void reset();
+  void wait();
+  int64_t next_deadline();
+  void print_stats();
+
+  int64_t get_frames() { return frames; }
+  int64_t get_late_frames() { return late_frames; }
+  double get_jitter_us();
+
+  // CLOCK_MONOTONIC in nanoseconds.
+  static int64_t get_time();
+
+  // NTSC is 60 fields a second slowed down by 1000 / 1001.
+  static constexpr double NTSC_HZ = 60000.0 / 1001.0;
+
+private:
+  bool advance(int64_t now);
+  void count_frame(int64_t now);
+
+  static const int MAX_BEHIND = 4;
+
+  // Nanoseconds.
+  int64_t period;
+  int64_t spin;
+  int64_t deadline;
+  int64_t last_frame;
+
+  int64_t frames;
+  int64_t late_frames;
+  int64_t resyncs;
+  int64_t max_late;
+
+  // Running mean and sum of squared differences of the time between
+  // frames in microseconds (Welford's method).
+  int64_t intervals;
+  double mean;
+  double m2;
+  double min_interval;
+  double max_interval;
+};
+
+#endif
+
@@ -0,0 +1,403 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FrontDoor.h"
+
+FrontDoor::FrontDoor() :
+  last_check{0}
+{
+  memset(directory, 0, sizeof(directory));
+
+  for (int n = 0; n < MAX_PENDING; n++)
+  {
+    pending[n].fd = -1;
+    pending[n].start = 0;
+    pending[n].input_length = 0;
+  }
+}
+
+FrontDoor::~FrontDoor()
+{
+  for (int n = 0; n < MAX_PENDING; n++)
+  {
+    if (pending[n].fd != -1) { net_disconnect(pending[n].fd); }
+  }
+
+  net_close();
+}
+
+int FrontDoor::init(const char *directory, int port)
+{
+  if (strlen(directory) >= sizeof(this->directory))
+  {
+    printf("Directory %s is too long.\n", directory);
+    return -1;
+  }
+
+  strcpy(this->directory, directory);
+
+  if (net_listen(port) != 0) { return -1; }
+  if (net_watch(socket_id) != 0) { return -1; }
+
+  printf("Front door for %s on port %d.\n", directory, port);
+
+  return 0;
+}
+
+void FrontDoor::run()
+{
+  struct epoll_event ready[MAX_PENDING + 1];
+
+  while (true)
+  {
+    const int count = net_wait(ready, MAX_PENDING + 1, 1000);
+
+    if (count < 0) { break; }
+
+    for (int n = 0; n < count; n++)
+    {
+      const int fd = ready[n].data.fd;
+
+      if (fd == socket_id)
+      {
+        int client_fd;
+
+        while ((client_fd = net_accept()) != -1)
+        {
+          add_pending(client_fd);
+        }
+
+        continue;
+      }
+
+      Pending *connection = find_pending(fd);
+
+      if (connection != nullptr)
+      {
+        read_pending(*connection);
+        continue;
+      }
+
+      // Something else a subclass is watching.
+      service(fd);
+    }
+
+    check_pending();
+  }
+}
+
+void FrontDoor::add_pending(int fd)
+{
+  for (int n = 0; n < MAX_PENDING; n++)
+  {
+    if (pending[n].fd != -1) { continue; }
+
+    pending[n].fd = fd;
+    pending[n].start = time(NULL);
+    pending[n].input_length = 0;
+
+    if (net_watch(fd) != 0) { remove_pending(pending[n]); }
+
+    return;
+  }
+
+  printf("Too many connections.\n");
+  net_disconnect(fd);
+}
+
+void FrontDoor::remove_pending(Pending &pending)
+{
+  net_disconnect(pending.fd);
+
+  pending.fd = -1;
+  pending.input_length = 0;
+}
+
+FrontDoor::Pending *FrontDoor::find_pending(int fd)
+{
+  for (int n = 0; n < MAX_PENDING; n++)
+  {
+    if (pending[n].fd == fd) { return &pending[n]; }
+  }
+
+  return nullptr;
+}
+
+int FrontDoor::read_pending(Pending &pending)
+{
+  // Reads until the first line of the request is in, which says where
+  // the connection goes. Returns -1 if it was closed.
+  while (true)
+  {
+    const int space = sizeof(pending.input) - pending.input_length;
+
+    if (space == 0)
+    {
+      remove_pending(pending);
+      return -1;
+    }
+
+    const int length = net_recv_some(
+      pending.fd,
+      pending.input + pending.input_length,
+      space);
+
+    if (length < 0)
+    {
+      remove_pending(pending);
+      return -1;
+    }
+
+    if (length == 0) { return 0; }
+
+    pending.input_length += length;
+
+    const char *line = (const char *)pending.input;
+    const char *end = (const char *)memchr(line, '\n', pending.input_length);
+
+    if (end == nullptr) { continue; }
+
+    if (strncmp(line, "GET /", 5) != 0)
+    {
+      send_response(pending.fd, "400 Bad Request", nullptr);
+    }
+      else
+    {
+      char path[256];
+      int n = 0;
+
+      line += 4;
+
+      while (line + n < end && line[n] != ' ' && n < (int)sizeof(path) - 1)
+      {
+        path[n] = line[n];
+        n++;
+      }
+
+      path[n] = 0;
+
+      route(pending, path);
+    }
+
+    // The connection was closed or handed to a game.
+    pending.fd = -1;
+    pending.input_length = 0;
+
+    return 0;
+  }
+}
+
+int FrontDoor::route(Pending &pending, const char *path)
+{
+  char name[48];
+  char location[64];
+  char socket_path[128];
+  int n = 0;
+
+  path++;
+
+  while (path[n] != 0 && path[n] != '/' && path[n] != '?')
+  {
+    const char c = path[n];
+
+    // The name is used as a file name, so only plain ones are allowed.
+    if (n == (int)sizeof(name) - 1 ||
+       !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'))
+    {
+      n = 0;
+      break;
+    }
+
+    name[n++] = c;
+  }
+
+  name[n] = 0;
+
+  if (n == 0 || name[0] == '.')
+  {
+    send_response(pending.fd, "404 Not Found", nullptr);
+    return -1;
+  }
+
+  // The page asks for everything else relative to /name/.
+  if (path[n] != '/')
+  {
+    snprintf(location, sizeof(location), "/%s/", name);
+    send_response(pending.fd, "301 Moved Permanently", location);
+    return 0;
+  }
+
+  snprintf(socket_path, sizeof(socket_path), "%s/%s.sock",
+    directory, name);
+
+  // The game adds it to its own epoll.
+  net_unwatch(pending.fd);
+
+  const int result = net_handoff(
+    socket_path,
+    pending.fd,
+    pending.input,
+    pending.input_length);
+
+  if (result == -2)
+  {
+    send_response(pending.fd, "503 Service Unavailable", nullptr);
+    return -1;
+  }
+
+  if (result < 0)
+  {
+    send_response(pending.fd, "404 Not Found", nullptr);
+    return -1;
+  }
+
+  // The game has its own copy of the connection now.
+  close(pending.fd);
+
+  return 0;
+}
+
+int FrontDoor::route_game(Pending &pending, const char *path)
+{
+  char location[32];
+
+  if (strncmp(path, "/play?", 6) == 0)
+  {
+    char name[128];
+    const char *rom = path + 6;
+    int n = 0;
+
+    while (rom[n] != 0 && rom[n] != '&' && n < (int)sizeof(name) - 1)
+    {
+      name[n] = rom[n];
+      n++;
+    }
+
+    name[n] = 0;
+
+    // Only files right in the ROM directory.
+    int id = -1;
+
+    if (name[0] != 0 && name[0] != '.' &&
+        strchr(name, '/') == nullptr && strchr(name, '%') == nullptr)
+    {
+      id = start_game(name);
+    }
+
+    if (id == -2)
+    {
+      send_response(pending.fd, "503 Service Unavailable", nullptr);
+      return -1;
+    }
+
+    if (id < 0)
+    {
+      send_response(pending.fd, "404 Not Found", nullptr);
+      return -1;
+    }
+
+    snprintf(location, sizeof(location), "/%d/", id);
+    send_response(pending.fd, "302 Found", location);
+
+    return 0;
+  }
+
+  if (path[1] < '0' || path[1] > '9')
+  {
+    send_response(pending.fd, "404 Not Found", nullptr);
+    return -1;
+  }
+
+  const int id = atoi(path + 1);
+  int n = 1;
+
+  while (path[n] >= '0' && path[n] <= '9') { n++; }
+
+  if (!has_game(id))
+  {
+    send_response(pending.fd, "404 Not Found", nullptr);
+    return -1;
+  }
+
+  // The page asks for everything else relative to /id/.
+  if (path[n] != '/')
+  {
+    snprintf(location, sizeof(location), "/%d/", id);
+    send_response(pending.fd, "301 Moved Permanently", location);
+    return 0;
+  }
+
+  // The game adds it to its own epoll.
+  net_unwatch(pending.fd);
+
+  return join_game(id, pending);
+}
+
+void FrontDoor::check_pending()
+{
+  const time_t now = time(NULL);
+
+  if (now == last_check) { return; }
+
+  for (int n = 0; n < MAX_PENDING; n++)
+  {
+    if (pending[n].fd == -1) { continue; }
+
+    if (now - pending[n].start >= PENDING_SECONDS)
+    {
+      remove_pending(pending[n]);
+    }
+  }
+
+  last_check = now;
+}
+
+void FrontDoor::send_response(
+  int fd,
+  const char *status,
+  const char *location)
+{
+  char response[256];
+  uint8_t buffer[1024];
+
+  if (location != nullptr)
+  {
+    snprintf(response, sizeof(response),
+      "HTTP/1.1 %s\r\n"
+      "Location: %s\r\n"
+      "Content-Length: 0\r\n"
+      "Connection: close\r\n\r\n",
+      status, location);
+  }
+    else
+  {
+    snprintf(response, sizeof(response),
+      "HTTP/1.1 %s\r\n"
+      "Content-Length: 0\r\n"
+      "Connection: close\r\n\r\n",
+      status);
+  }
+
+  // The rest of the request is read first, since closing a socket with
+  // data still waiting resets the connection and the browser might
+  // never see the response.
+  while (net_recv_some(fd, buffer, sizeof(buffer)) > 0) { }
+
+  net_send_some(fd, (const uint8_t *)response, strlen(response));
+  net_disconnect(fd);
+}
+
@@ -0,0 +1,79 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * FrontDoor listens on one port for all the games running on a machine,
+ * each in its own process started with "http <directory>/name.sock".
+ *
+ * It reads the first line of each request and passes the connection,
+ * along with what it read, to the game at /name/ over its Unix socket.
+ * After that the game and the browser talk directly and the FrontDoor
+ * is out of the way, so it never touches a frame. /name without the
+ * slash is redirected to /name/ so the page's relative paths work.
+ *
+ * ProcessPool is a FrontDoor with its own games, each in a process, and
+ * SessionServer is one with its games all in its own process. Both use
+ * route_game(): GET /play?game.bin starts a game with that ROM and
+ * redirects the browser to /id/, and the connections for /id/ are
+ * passed to that game. They only have to start, find and join games.
+ *
+ */
+
+#ifndef FRONT_DOOR_H
+#define FRONT_DOOR_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "Network.h"
+
+class FrontDoor : public Network
+{
+public:
+  FrontDoor();
+  virtual ~FrontDoor();
+
+  int init(const char *directory, int port);
+  void run();
+
+protected:
+  // A new connection that hasn't sent its first request line yet.
+  struct Pending
+  {
+    int fd;
+    time_t start;
+    uint8_t input[MAX_HANDOFF_DATA];
+    int input_length;
+  };
+
+  void add_pending(int fd);
+  void remove_pending(Pending &pending);
+  Pending *find_pending(int fd);
+  int read_pending(Pending &pending);
+  virtual int route(Pending &pending, const char *path);
+  virtual void check_pending();
+  virtual void service(int fd) { }
+  int route_game(Pending &pending, const char *path);
+  virtual int start_game(const char *name) { return -1; }
+  virtual bool has_game(int id) { return false; }
+  virtual int join_game(int id, Pending &pending) { return -1; }
+  void send_response(int fd, const char *status, const char *location);
+
+  static const int MAX_PENDING = 64;
+
+  // Connections that don't send a request line in this long are closed.
+  static const int PENDING_SECONDS = 10;
+
+  // The sockets, or for a ProcessPool the ROMs.
+  char directory[64];
+  time_t last_check;
+  Pending pending[MAX_PENDING];
+};
+
+#endif
+
@@ -18,12 +18,18 @@
 
 #include "GifCompressor.h"
 
-GifCompressor::GifCompressor() : gif_length{0}
+GifCompressor::GifCompressor() :
+  generation{1},
+  gif_length{0},
+  lzw{nullptr},
+  lzw_length{0},
+  box{nullptr}
 {
   data_length = 65536;
   data = (uint8_t *)malloc(data_length);
 
   memset(data, 0, data_length);
+  memset(hash_table, 0, sizeof(hash_table));
 
   memset(&gif_header, 0, sizeof(gif_header));
   memcpy(gif_header.version, "GIF87a", 6);
@@ -32,11 +38,169 @@ GifCompressor::GifCompressor() : gif_length{0}
 
 GifCompressor::~GifCompressor()
 {
+  free(data);
+  free(lzw);
+  free(box);
 }
 
 int GifCompressor::compress(uint8_t *image, uint32_t *color_table)
 {
-  int ptr = 6, i;
+  resize_buffers(gif_header.width * gif_header.height);
+
+  return encode(
+    image,
+    0,
+    0,
+    gif_header.width,
+    gif_header.height,
+    color_table,
+    MODE_FILE);
+}
+
+int GifCompressor::compress_delta(
+  uint8_t *image,
+  uint8_t *previous,
+  uint32_t *color_table)
+{
+  int left, top, width, height;
+
+  resize_buffers(gif_header.width * gif_header.height);
+  make_delta(image, previous, left, top, width, height);
+
+  return encode(box, left, top, width, height, color_table, MODE_DELTA);
+}
+
+int GifCompressor::stream_header()
+{
+  // Logical Screen Descriptor with no global color table. Each frame
+  // from stream_frame() has its own.
+  memcpy(data, "GIF89a", 6);
+  set_uint16(data, 6, gif_header.width);
+  set_uint16(data, 8, gif_header.height);
+  data[10] = 0;
+  data[11] = 0;
+  data[12] = 0;
+
+  gif_length = 13;
+
+  return 0;
+}
+
+int GifCompressor::stream_frame(
+  uint8_t *image,
+  uint8_t *previous,
+  uint32_t *color_table)
+{
+  resize_buffers(gif_header.width * gif_header.height);
+
+  if (previous == nullptr)
+  {
+    return encode(
+      image,
+      0,
+      0,
+      gif_header.width,
+      gif_header.height,
+      color_table,
+      MODE_STREAM);
+  }
+
+  int left, top, width, height;
+
+  make_delta(image, previous, left, top, width, height);
+
+  return encode(box, left, top, width, height, color_table, MODE_STREAM);
+}
+
+void GifCompressor::make_delta(
+  uint8_t *image,
+  uint8_t *previous,
+  int &left,
+  int &top,
+  int &box_width,
+  int &box_height)
+{
+  const int width = gif_header.width;
+  const int height = gif_header.height;
+  int bottom = height - 1;
+  int right = -1;
+  int x, y;
+
+  top = 0;
+  left = width;
+
+  // Find the rectangle around every pixel that changed.
+  while (top < height &&
+         memcmp(image + (top * width), previous + (top * width), width) == 0)
+  {
+    top++;
+  }
+
+  if (top == height)
+  {
+    // Nothing changed so send one transparent pixel.
+    box[0] = TRANSPARENT;
+    left = 0;
+    top = 0;
+    box_width = 1;
+    box_height = 1;
+
+    return;
+  }
+
+  while (memcmp(
+    image + (bottom * width),
+    previous + (bottom * width),
+    width) == 0)
+  {
+    bottom--;
+  }
+
+  for (y = top; y <= bottom; y++)
+  {
+    const uint8_t *line = image + (y * width);
+    const uint8_t *previous_line = previous + (y * width);
+
+    for (x = 0; x < left; x++)
+    {
+      if (line[x] != previous_line[x]) { left = x; break; }
+    }
+
+    for (x = width - 1; x > right; x--)
+    {
+      if (line[x] != previous_line[x]) { right = x; break; }
+    }
+  }
+
+  box_width = right - left + 1;
+  box_height = bottom - top + 1;
+
+  uint8_t *pixel = box;
+
+  // Pixels that are the same as the last frame are left transparent so
+  // the browser keeps what it already drew there.
+  for (y = top; y <= bottom; y++)
+  {
+    const uint8_t *line = image + (y * width);
+    const uint8_t *previous_line = previous + (y * width);
+
+    for (x = left; x <= right; x++)
+    {
+      *pixel++ = line[x] == previous_line[x] ? TRANSPARENT : line[x];
+    }
+  }
+}
+
+int GifCompressor::encode(
+  uint8_t *image,
+  int left,
+  int top,
+  int width,
+  int height,
+  uint32_t *color_table,
+  int mode)
+{
+  int ptr = 0, i;
 
   // Remap the colors from the 128 color palette to a smaller palette
   // so the GIF compresses more.
@@ -46,22 +210,54 @@ int GifCompressor::compress(uint8_t *image, uint32_t *color_table)
 
   memset(color_map, 0, sizeof(color_map));
   memset(color_used, 0, sizeof(color_used));
+  memset(gif_palette, 0, sizeof(gif_palette));
 
-  int length = gif_header.width * gif_header.height;
+  int length = width * height;
   int max_colors = 0;
 
-  // Remap colors to GIF palette.
-  for (i = 0; i < length; i++)
+  // Remap colors to GIF palette. Colors are numbered in the order they
+  // are first seen, so 8 pixels matching the 8 before them or the 8 on
+  // the line above can be skipped.
+  uint64_t last_chunk = 0;
+
+  for (i = 0; i < length; i += 8)
   {
-    int color = image[i];
+    const int count = length - i < 8 ? length - i : 8;
+
+    if (count == 8)
+    {
+      uint64_t chunk;
+
+      memcpy(&chunk, image + i, sizeof(chunk));
+
+      if (i != 0 && chunk == last_chunk) { continue; }
+
+      last_chunk = chunk;
 
-    if (color_used[color]) { continue; }
+      if (i >= width && memcmp(image + i, image + i - width, 8) == 0)
+      {
+        continue;
+      }
+    }
+
+    for (int n = 0; n < count; n++)
+    {
+      int color = image[i + n];
+
+      if (color_used[color]) { continue; }
+
+      color_map[color] = max_colors;
+      color_used[color] = 1;
 
-    color_map[color] = max_colors;
-    color_used[color] = 1;
-    gif_palette[max_colors] = color_table[color];
+      // The color table only has the 128 Atari colors. The transparent
+      // color's entry is never shown, so it's left black.
+      if (color != TRANSPARENT)
+      {
+        gif_palette[max_colors] = color_table[color];
+      }
 
-    max_colors++;
+      max_colors++;
+    }
   }
 
   // FIXME: Why is this happening?
@@ -73,30 +269,58 @@ int GifCompressor::compress(uint8_t *image, uint32_t *color_table)
   max_colors = 1 << bits_per_pixel;
 //printf("max_colors=%d bits_per_pixel=%d\n", max_colors, bits_per_pixel);
 
-  // Copy GifHeader (Logical Screen Descriptor) to memory.
-  set_uint16(data, ptr + 0, gif_header.width);
-  set_uint16(data, ptr + 2, gif_header.height);
-  data[ptr + 4] = 0x80 | ((color_resolution - 1) << 4) | (bits_per_pixel - 1);
-  data[ptr + 5] = 0;
-  data[ptr + 6] = 0;
-  ptr += 7;
+  if (mode != MODE_STREAM)
+  {
+    // Delta frames need GIF89a for the transparent color.
+    memcpy(data, mode == MODE_DELTA ? "GIF89a" : "GIF87a", 6);
+    ptr += 6;
+
+    // Copy GifHeader (Logical Screen Descriptor) to memory.
+    set_uint16(data, ptr + 0, gif_header.width);
+    set_uint16(data, ptr + 2, gif_header.height);
+    data[ptr + 4] =
+      0x80 | ((color_resolution - 1) << 4) | (bits_per_pixel - 1);
+    data[ptr + 5] = 0;
+    data[ptr + 6] = 0;
+    ptr += 7;
+
+    // Global Color Map (palettes).
+    ptr = write_palette(ptr, gif_palette, max_colors);
+  }
 
-  // Global Color Map (palettes).
-  for (i = 0; i < max_colors; i++)
+  // Graphic Control Extension with the transparent color. Disposal
+  // method 1 leaves the image in place. Streamed frames have a delay
+  // of 20ms, the shortest that browsers don't slow down.
+  if (mode != MODE_FILE)
   {
-    data[ptr++] = (gif_palette[i] >> 16) & 0xff;
-    data[ptr++] = (gif_palette[i] >> 8) & 0xff;
-    data[ptr++] =  gif_palette[i] & 0xff;
+    data[ptr + 0] = 0x21;
+    data[ptr + 1] = 0xf9;
+    data[ptr + 2] = 4;
+    data[ptr + 3] = (1 << 2) | (color_used[TRANSPARENT] ? 1 : 0);
+    set_uint16(data, ptr + 4, mode == MODE_STREAM ? 2 : 0);
+    data[ptr + 6] = color_map[TRANSPARENT];
+    data[ptr + 7] = 0;
+    ptr += 8;
   }
 
   // Image Descriptor Block.
   data[ptr + 0] = ',';
-  set_uint16(data, ptr + 1, 0);
-  set_uint16(data, ptr + 3, 0);
-  set_uint16(data, ptr + 5, gif_header.width);
-  set_uint16(data, ptr + 7, gif_header.height);
+  set_uint16(data, ptr + 1, left);
+  set_uint16(data, ptr + 3, top);
+  set_uint16(data, ptr + 5, width);
+  set_uint16(data, ptr + 7, height);
   data[ptr + 9] = bits_per_pixel - 1;
-  ptr += 10;
+
+  if (mode == MODE_STREAM)
+  {
+    // Local Color Map.
+    data[ptr + 9] |= 0x80;
+    ptr = write_palette(ptr + 10, gif_palette, max_colors);
+  }
+    else
+  {
+    ptr += 10;
+  }
 
   int code_size = bits_per_pixel;
   int clear_code = max_colors;
@@ -104,83 +328,133 @@ int GifCompressor::compress(uint8_t *image, uint32_t *color_table)
 
   data[ptr++] = code_size;
 
-  // Setup LZW tree.
-  CompressNode node[4097];
-
-  for (i = 0; i < max_colors; i++)
-  {
-    node[i].color = i;
-    node[i].right = i + 1;
-    node[i].down = -1;
-  }
-
   // Compressed data blocks follow.
   int table_start_size = max_colors + 2;
   int next_code = table_start_size;
   int curr_code_size = code_size + 1;
-  int curr_code = -1;
-  int data_size = 0;
+  int curr_code;
 
-  // LZW Compression.
-  BitStream bit_stream;
+  next_generation();
 
-  bit_stream.append(clear_code, curr_code_size);
+  // LZW Compression. The codes are packed into the lzw buffer and split
+  // into 255 byte sub-blocks afterwards.
+  BitWriter bit_writer(lzw);
+
+  bit_writer.append(clear_code, curr_code_size);
 
   int image_ptr = 0;
-  uint8_t color = color_map[image[image_ptr++]];
-  int block_ptr;
 
-  block_ptr = ptr;
-  data[ptr++] = 0;
+  curr_code = color_map[image[image_ptr++]];
 
-  curr_code = color;
-  int last_code = curr_code;
+  // While the current string is one color repeated run_length times,
+  // the pixels that continue it can be matched against run_code[]
+  // in one step instead of one table lookup per pixel.
+  uint8_t run_pixel = image[0];
+  int run_color = curr_code;
+  int run_length = 1;
 
-  while (image_ptr < length)
+  for (i = 0; i < max_colors; i++)
   {
-    color = color_map[image[image_ptr++]];
+    run_code[i][1] = i;
+    run_max[i] = 1;
+    last_child[i] = NO_CHILD;
+  }
 
-    if (node[curr_code].down == -1)
-    {
-      last_code = curr_code;
-      node[curr_code].down = next_code;
-    }
-      else
+  while (image_ptr < length)
+  {
+    if (run_length != 0 &&
+        run_length < run_max[run_color] &&
+        image[image_ptr] == run_pixel)
     {
-      last_code = curr_code;
-      curr_code = node[curr_code].down;
+      int count = run_max[run_color] - run_length;
+      int n = 1;
 
-      while (node[curr_code].color != color && node[curr_code].right != -1)
-      {
-        curr_code=node[curr_code].right;
-      }
+      if (count > length - image_ptr) { count = length - image_ptr; }
 
-      if (node[curr_code].color != color && node[curr_code].right == -1)
-      {
-        node[curr_code].right=next_code;
-      }
-        else
+      const uint64_t pattern = run_pixel * 0x0101010101010101ULL;
+
+      while (n + 8 <= count)
       {
-        continue;
+        uint64_t chunk;
+
+        memcpy(&chunk, image + image_ptr + n, sizeof(chunk));
+
+        if (chunk != pattern) { break; }
+
+        n += 8;
       }
+
+      while (n < count && image[image_ptr + n] == run_pixel) { n++; }
+
+      image_ptr += n;
+      run_length += n;
+      curr_code = run_code[run_color][run_length];
+
+      continue;
+    }
+
+    uint8_t color = color_map[image[image_ptr++]];
+
+    // Check the last string found after this one before the hash table.
+    const uint32_t child = last_child[curr_code];
+
+    if ((child >> 16) == color)
+    {
+      curr_code = child & 0xffff;
+      run_length = 0;
+      continue;
+    }
+
+    const uint32_t key = (curr_code << 8) | color;
+    int slot = hash(key);
+
+    while (hash_table[slot].generation == generation &&
+           hash_table[slot].key != key)
+    {
+      slot = (slot + 1) & HASH_MASK;
+    }
+
+    if (hash_table[slot].generation == generation)
+    {
+      // Only a run longer than RUN_MAX can still be one color here.
+      last_child[curr_code] = (color << 16) | hash_table[slot].code;
+      curr_code = hash_table[slot].code;
+      run_length = 0;
+      continue;
     }
 
-    bit_stream.append(last_code, curr_code_size);
+    bit_writer.append(curr_code, curr_code_size);
+
+    hash_table[slot].key = key;
+    hash_table[slot].code = next_code;
+    hash_table[slot].generation = generation;
+    last_child[curr_code] = (color << 16) | next_code;
+    last_child[next_code] = NO_CHILD;
+
+    if (run_length != 0 && color == run_color && run_length < RUN_MAX)
+    {
+      run_length++;
+      run_code[color][run_length] = next_code;
+      run_max[color] = run_length;
+    }
 
-    node[next_code].right = -1;
-    node[next_code].down = -1;
-    node[next_code].color = color;
     curr_code = color;
+    run_pixel = image[image_ptr - 1];
+    run_color = color;
+    run_length = 1;
 
     if ((next_code >> curr_code_size) != 0)
     {
       if (curr_code_size >= 12)
       {
-        bit_stream.append(clear_code, curr_code_size);
+        bit_writer.append(clear_code, curr_code_size);
+
+        next_generation();
 
         for (i = 0; i < max_colors; i++)
         {
-          node[i].down = -1;
+          run_max[i] = 1;
+          last_child[i] = NO_CHILD;
         }
 
         next_code = table_start_size - 1;
@@ -191,53 +465,85 @@ int GifCompressor::compress(uint8_t *image, uint32_t *color_table)
     }
 
     next_code++;
-
-    while (bit_stream.size() >= 8)
-    {
-      data[ptr++] = bit_stream.get_byte();
-      data_size++;
-
-      if (data_size >= 255)
-      {
-        data[block_ptr] = data_size;
-        data_size = 0;
-        block_ptr = ptr;
-        data[ptr++] = 0;
-      }
-    }
   }
 
-  bit_stream.append(curr_code, curr_code_size);
-  bit_stream.append(eof_code, curr_code_size);
+  bit_writer.append(curr_code, curr_code_size);
+  bit_writer.append(eof_code, curr_code_size);
 
-  while (bit_stream.size() > 0)
-  {
-    data[ptr++] = bit_stream.get_byte();
-    data_size++;
+  int count = bit_writer.flush() - lzw;
+  const uint8_t *block = lzw;
 
-    if (data_size >= 255)
-    {
-      data[block_ptr] = data_size;
-      data_size = 0;
-      block_ptr = ptr;
-      data[ptr++] = 0;
-    }
+  while (count >= 255)
+  {
+    data[ptr++] = 255;
+    memcpy(data + ptr, block, 255);
+    ptr += 255;
+    block += 255;
+    count -= 255;
   }
 
-  if (data_size > 0)
+  if (count != 0)
   {
-    data[block_ptr] = data_size;
+    data[ptr++] = count;
+    memcpy(data + ptr, block, count);
+    ptr += count;
   }
 
   // End Marker.
   data[ptr++] = 0;
-  data[ptr++] = ';';
+
+  if (mode != MODE_STREAM) { data[ptr++] = ';'; }
 
   gif_length = ptr;
 
   return 0;
 }
 
+void GifCompressor::resize_buffers(int length)
+{
+  // Worst case is one 12 bit code per pixel plus the clear codes.
+  const int needed = length * 2 + 16;
+
+  if (needed <= lzw_length) { return; }
+
+  lzw_length = needed;
+  lzw = (uint8_t *)realloc(lzw, lzw_length);
+  box = (uint8_t *)realloc(box, length);
+
+  // Header, 256 color palette, image descriptor and the sub-block
+  // length bytes.
+  const int gif_needed = 1024 + lzw_length + (lzw_length / 255) + 16;
+
+  if (gif_needed > data_length)
+  {
+    data_length = gif_needed;
+    data = (uint8_t *)realloc(data, data_length);
+  }
+}
+
+int GifCompressor::write_palette(int ptr, uint32_t *palette, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    data[ptr++] = (palette[i] >> 16) & 0xff;
+    data[ptr++] = (palette[i] >> 8) & 0xff;
+    data[ptr++] =  palette[i] & 0xff;
+  }
+
+  return ptr;
+}
+
+void GifCompressor::next_generation()
+{
+  generation++;
+
+  if (generation == 0)
+  {
+    memset(hash_table, 0, sizeof(hash_table));
+    generation = 1;
+  }
+}
+
 int GifCompressor::compute_bits_per_pixel(int max_colors)
 {
   uint8_t counts[16] =
@@ -11,6 +11,14 @@
  * them into GIF files. This is used by TelevisionHttp for sending to
  * a webbrowser a stream of GIF images as the video display.
  *
+ * compress_delta() makes a GIF89a with only the rectangle of pixels
+ * that changed since the previous frame. Unchanged pixels inside it are
+ * transparent so the browser can draw it over the last frame.
+ *
+ * stream_header() and stream_frame() make the pieces of one animated
+ * GIF that never ends for sending frames as they are drawn. Pass
+ * nullptr as previous to send a whole frame.
+ *
  */
 
 #ifndef GIF_COMPRESSOR_H
@@ -25,6 +33,9 @@ public:
   ~GifCompressor();
 
   int compress(uint8_t *image, uint32_t *color_table);
+  int compress_delta(uint8_t *image, uint8_t *previous, uint32_t *color_table);
+  int stream_header();
+  int stream_frame(uint8_t *image, uint8_t *previous, uint32_t *color_table);
   void set_width(int value) { gif_header.width = value; }
   void set_height(int value) { gif_header.height = value; }
   uint8_t *get_gif_data() { return data; }
@@ -57,35 +68,50 @@ private:
     uint8_t color;
   };
 
-  struct CompressNode
+  struct HashEntry
   {
-    int down;
-    int right;
-    uint8_t color;
+    uint32_t key;
+    uint16_t code;
+    uint16_t generation;
   };
 
-  struct BitStream
+  struct BitWriter
   {
-    BitStream() : data{0}, bitptr{0} { }
+    BitWriter(uint8_t *data) : data{data}, bits{0}, bitptr{0} { }
 
-    int size() { return bitptr; }
-    void dump() { printf("--> data=0x%08x bitptr=%d\n", data, bitptr); }
-
-    uint8_t get_byte()
+    // Codes are at most 12 bits so after writing out 32 bits there is
+    // always room in the 64 bit accumulator for the next one.
+    void append(int value, int size)
     {
-      uint8_t next = data & 0xff;
-      data = data >> 8;
-      bitptr -= 8;
-      return next;
+      bits |= (uint64_t)value << bitptr;
+      bitptr += size;
+
+      if (bitptr >= 32)
+      {
+        data[0] = bits & 0xff;
+        data[1] = (bits >> 8) & 0xff;
+        data[2] = (bits >> 16) & 0xff;
+        data[3] = (bits >> 24) & 0xff;
+        data += 4;
+        bits = bits >> 32;
+        bitptr -= 32;
+      }
     }
 
-    void append(int value, int size)
+    uint8_t *flush()
     {
-      data |= value << bitptr;
-      bitptr += size;
+      while (bitptr > 0)
+      {
+        *data++ = bits & 0xff;
+        bits = bits >> 8;
+        bitptr -= 8;
+      }
+
+      return data;
     }
 
-    uint32_t data;
+    uint8_t *data;
+    uint64_t bits;
     int bitptr;
   };
 
@@ -95,12 +121,72 @@ private:
     *(data + ptr + 1) = value >> 8;
   }
 
+  enum
+  {
+    MODE_FILE,
+    MODE_DELTA,
+    MODE_STREAM,
+  };
+
+  void make_delta(
+    uint8_t *image,
+    uint8_t *previous,
+    int &left,
+    int &top,
+    int &box_width,
+    int &box_height);
+
+  int encode(
+    uint8_t *image,
+    int left,
+    int top,
+    int width,
+    int height,
+    uint32_t *color_table,
+    int mode);
+
+  int write_palette(int ptr, uint32_t *palette, int count);
+
   inline int compute_bits_per_pixel(int max_colors);
+  void resize_buffers(int length);
+  void next_generation();
+
+  static int hash(uint32_t key)
+  {
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+  }
+
+  // LZW strings are looked up by (prefix code << 8) | color. The table
+  // is at most half full with 4096 codes. Bumping the generation empties
+  // it without clearing memory on every LZW clear code.
+  static const int HASH_BITS = 13;
+  static const int HASH_SIZE = 1 << HASH_BITS;
+  static const int HASH_MASK = HASH_SIZE - 1;
+
+  // run_code[color][n] is the code for color repeated n times. LZW adds
+  // these one pixel longer at a time so all lengths up to run_max exist.
+  static const int RUN_MAX = 255;
+
+  // Pixel value in a delta image for a pixel that didn't change. Frame
+  // pixels are ColorTable indexes 0 to 127.
+  static const uint8_t TRANSPARENT = 0xff;
+
+  // Color << 16 | code of the last string found after each code.
+  static const uint32_t NO_CHILD = 0xffffffff;
+
+  HashEntry hash_table[HASH_SIZE];
+  uint16_t generation;
+  uint16_t run_code[256][RUN_MAX + 1];
+  int run_max[256];
+  uint32_t last_child[4097];
 
   GifHeader gif_header;
   uint8_t *data;
   int data_length;
   int gif_length;
+  uint8_t *lzw;
+  int lzw_length;
+  uint8_t *box;
 };
 
 #endif
@@ -0,0 +1,146 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ColorTable.h"
+#include "ImageScaler.h"
+
+void ImageScaler::scale_line(
+  uint32_t *row,
+  const uint8_t *line,
+  int length,
+  int scale)
+{
+  const uint32_t *color_table = ColorTable::get_table();
+  int n = 0;
+
+#if defined(__AVX2__)
+  const __m256i repeat_2_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256i repeat_2_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+  const __m256i repeat_3_0 = _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2);
+  const __m256i repeat_3_1 = _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5);
+  const __m256i repeat_3_2 = _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7);
+
+  for (n = 0; n + 8 <= length; n += 8)
+  {
+    const __m256i index =
+      _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(line + n)));
+    const __m256i color =
+      _mm256_i32gather_epi32((const int *)color_table, index, 4);
+
+    __m256i *out = (__m256i *)(row + (n * scale));
+
+    switch (scale)
+    {
+      case 1:
+        _mm256_storeu_si256(out, color);
+        break;
+      case 2:
+        _mm256_storeu_si256(out + 0,
+          _mm256_permutevar8x32_epi32(color, repeat_2_lo));
+        _mm256_storeu_si256(out + 1,
+          _mm256_permutevar8x32_epi32(color, repeat_2_hi));
+        break;
+      default:
+        _mm256_storeu_si256(out + 0,
+          _mm256_permutevar8x32_epi32(color, repeat_3_0));
+        _mm256_storeu_si256(out + 1,
+          _mm256_permutevar8x32_epi32(color, repeat_3_1));
+        _mm256_storeu_si256(out + 2,
+          _mm256_permutevar8x32_epi32(color, repeat_3_2));
+        break;
+    }
+  }
+#elif defined(__SSE2__)
+  for (n = 0; n + 4 <= length; n += 4)
+  {
+    const __m128i color = _mm_setr_epi32(
+      color_table[line[n + 0]],
+      color_table[line[n + 1]],
+      color_table[line[n + 2]],
+      color_table[line[n + 3]]);
+
+    __m128i *out = (__m128i *)(row + (n * scale));
+
+    switch (scale)
+    {
+      case 1:
+        _mm_storeu_si128(out, color);
+        break;
+      case 2:
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi32(color, color));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi32(color, color));
+        break;
+      default:
+        _mm_storeu_si128(out + 0,
+          _mm_shuffle_epi32(color, _MM_SHUFFLE(1, 0, 0, 0)));
+        _mm_storeu_si128(out + 1,
+          _mm_shuffle_epi32(color, _MM_SHUFFLE(2, 2, 1, 1)));
+        _mm_storeu_si128(out + 2,
+          _mm_shuffle_epi32(color, _MM_SHUFFLE(3, 3, 3, 2)));
+        break;
+    }
+  }
+#endif
+
+  // Whatever is left over (or everything without SIMD).
+  scale_line_scalar(row + (n * scale), line + n, length - n, scale);
+}
+
+void ImageScaler::scale_line_scalar(
+  uint32_t *row,
+  const uint8_t *line,
+  int length,
+  int scale)
+{
+  const uint32_t *color_table = ColorTable::get_table();
+
+  for (int n = 0; n < length; n++)
+  {
+    const uint32_t color = color_table[line[n]];
+
+    for (int i = 0; i < scale; i++) { *row++ = color; }
+  }
+}
+
+void ImageScaler::scale_image(
+  uint32_t *image,
+  const uint8_t *frame,
+  int width,
+  int height,
+  int scale_x,
+  int scale_y)
+{
+  const int row_length = width * scale_x;
+
+  for (int y = 0; y < height; y++)
+  {
+    uint32_t *row = image + (y * scale_y * row_length);
+
+    scale_line(row, frame + (y * width), width, scale_x);
+
+    for (int i = 1; i < scale_y; i++)
+    {
+      memcpy(row + (i * row_length), row, row_length * sizeof(uint32_t));
+    }
+  }
+}
+
@@ -0,0 +1,51 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * ImageScaler converts lines of ColorTable indexes (as drawn by the TIA)
+ * into 32 bit pixels, repeating each pixel 1, 2, or 3 times across. With
+ * AVX2 the colors are looked up with gathers, with SSE2 they are loaded
+ * 4 at a time and repeated with shuffles, otherwise 1 pixel at a time.
+ *
+ */
+
+#ifndef IMAGE_SCALER_H
+#define IMAGE_SCALER_H
+
+#include <stdint.h>
+
+class ImageScaler
+{
+public:
+  static void scale_line(
+    uint32_t *row,
+    const uint8_t *line,
+    int length,
+    int scale);
+
+  static void scale_line_scalar(
+    uint32_t *row,
+    const uint8_t *line,
+    int length,
+    int scale);
+
+  static void scale_image(
+    uint32_t *image,
+    const uint8_t *frame,
+    int width,
+    int height,
+    int scale_x,
+    int scale_y);
+
+private:
+  ImageScaler() { }
+  ~ImageScaler() { }
+};
+
+#endif
+
@@ -11,11 +11,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 
 #include "Disassembler.h"
 #include "M6502.h"
 
 M6502::M6502() :
+  memory_bus{nullptr},
+  rom{nullptr},
+  decode_cache{nullptr},
+  cache_hits{0},
+  cache_misses{0},
   running{true},
   reg_a{0},
   reg_x{0},
@@ -29,6 +35,7 @@ M6502::M6502() :
 
 M6502::~M6502()
 {
+  delete [] decode_cache;
 }
 
 void M6502::reset()
@@ -41,6 +48,40 @@ void M6502::reset()
   sp = 0xff;
   total_cycles = 0;
   total_instructions = 0;
+
+  memory_bus->reset_cycle();
+
+  // The ROM could have changed since the last reset, so start with an
+  // empty decode cache sized for the number of banks.
+  rom = memory_bus->get_rom();
+
+  delete [] decode_cache;
+  decode_cache = new DecodedInstruction[rom->get_bank_count() * 4096]();
+  cache_hits = 0;
+  cache_misses = 0;
+}
+
+void M6502::save_state(State &state)
+{
+  state.total_cycles = total_cycles;
+  state.pc = pc;
+  state.sp = sp;
+  state.reg_a = reg_a;
+  state.reg_x = reg_x;
+  state.reg_y = reg_y;
+  state.reg_p = status.reg_p;
+}
+
+void M6502::load_state(const State &state)
+{
+  // The decode cache only depends on the ROM, so it's still good.
+  total_cycles = state.total_cycles;
+  pc = state.pc;
+  sp = state.sp;
+  reg_a = state.reg_a;
+  reg_x = state.reg_x;
+  reg_y = state.reg_y;
+  status.reg_p = state.reg_p;
 }
 
 void M6502::dump()
@@ -57,8 +98,19 @@ void M6502::dump()
     status.i,
     status.z,
     status.c);
-  printf(" total_instructions=%d\n", total_instructions);
-  printf(" total_cycles=%d\n", total_cycles);
+  printf(" total_instructions=%" PRIu64 "\n", total_instructions);
+  printf(" total_cycles=%" PRIu64 "\n", total_cycles);
+  dump_cache_stats();
+}
+
+void M6502::dump_cache_stats()
+{
+  const uint64_t total = cache_hits + cache_misses;
+
+  printf(" decode cache: hits=%" PRIu64 " misses=%" PRIu64 " (%.2f%%)\n",
+    cache_hits,
+    cache_misses,
+    total == 0 ? 0.0 : (100.0 * cache_hits) / total);
 }
 
 void M6502::illegal_instruction(uint8_t opcode)
@@ -69,23 +121,9 @@ void M6502::illegal_instruction(uint8_t opcode)
   exit(-1);
 }
 
-int M6502::step()
+int M6502::step_debug()
 {
-  int cycles = execute_instruction();
-
-  total_cycles += cycles;
-  total_instructions++;
-
-  return cycles;
-}
-
-int M6502::execute_instruction()
-{
-  int address = pc++;
-  uint8_t opcode = memory_bus->read(address);
-  int cycles = 0;
-  int a, b, c, data;
-  int8_t offset;
+  const int address = pc;
 
   if (debug)
   {
@@ -97,7 +135,7 @@ int M6502::execute_instruction()
 
     Disassembler::disassemble(code, address, text);
 
-    printf(" --- 0x%04x: %02x - %s ---\n", address, opcode, text);
+    printf(" --- 0x%04x: %02x - %s ---\n", address, code[0], text);
   }
 
   if (address == breakpoint)
@@ -106,807 +144,617 @@ int M6502::execute_instruction()
     stop();
   }
 
-  switch (opcode)
+  return step();
+}
+
+const M6502::DecodedInstruction *M6502::decode()
+{
+  DecodedInstruction *decoded = &decode_scratch;
+  const int offset = pc & 0x0fff;
+
+  decoded->instruction = &instructions[memory_bus->read(pc)];
+
+  const int length = decoded->instruction->length;
+
+  if (length == 2)
   {
-    case 0x00:     //  BRK
-      status.b = 1;
-      stop();
-      return 7;
-
-    case 0x01:     //  ORA (Indirect, X)
-      data = read_indirect_x(a);
-      run_or(data);
-      return 6;
-
-    case 0x05:     //  ORA Zero Page
-      data = read_zero_page(a);
-      run_or(data);
-      return 3;
-
-    case 0x06:     //  ASL Zero Page
-      data = read_zero_page(a);
-      run_asl_memory(a, data);
-      return 5;
-
-    case 0x08:     //  PHP
-      push(status.reg_p);
-      return 3;
-
-    case 0x09:     //  ORA #Immediate
-      data = read_immediate();
-      run_or(data);
-      return 2;
-
-    case 0x0a:     //  ASL <Accumulator>
-      reg_a <<= 1;
-      set_flags(reg_a);
-      return 2;
-
-    case 0x0d:     //  ORA Absolute
-      data = read_absolute(a);
-      run_or(data);
-      return 4;
-
-    case 0x0e:     //  ASL Absolute
-      data = read_absolute(a);
-      run_asl_memory(a, data);
-      return 6;
-
-    case 0x10:     //  BPL
-      offset = read_immediate();
-      a = pc;
-
-      if (status.n == 0)
-      {
-        pc += offset;
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0x11:     //  ORA (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_or(data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0x15:     //  ORA Zero Page, X
-      data = read_zero_page_x(a);
-      run_or(data);
-      return 4;
-
-    case 0x16:     //  ASL Zero Page, X
-      data = read_zero_page_x(a);
-      run_asl_memory(a, data);
-      return 6;
-
-    case 0x18:     //  CLC
-      status.c = 0;
-      return 2;
-
-    case 0x19:     //  ORA Absolute, Y
-      data = read_absolute_y(a, b);
-      run_or(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x1d:     //  ORA Absolute, X
-      data = read_absolute_x(a, b);
-      run_or(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x1e:     //  ASL Absolute, X
-      data = read_absolute_x(a, b);
-      run_asl_memory(a, data);
-      return 7;
-
-    case 0x20:     //  JSR
-      data = read_address();
-      push(pc >> 8);
-      push(pc & 0xff);
-      pc = data;
-      return 6;
-
-    case 0x21:     //  AND (Indirect, X)
-      data = read_indirect_x(a);
-      run_and(data);
-      return 6;
-
-    case 0x24:     //  BIT Zero Page
-      data = read_zero_page(a);
-      run_bit(data);
-      return 3;
-
-    case 0x25:     //  AND Zero Page
-      data = read_zero_page(a);
-      run_and(data);
-      return 3;
-
-    case 0x26:     //  ROL Zero Page
-      data = read_zero_page(a);
-      run_rol_memory(a, data);
-      return 5;
-
-    case 0x28:     //  PLP
-      status.reg_p = pop();
-      return 4;
-
-    case 0x29:     //  AND #Immediate
-      data = read_immediate();
-      run_and(data);
-      return 2;
-
-    case 0x2a:     //  ROL <Accumulator>
-      c = status.c;
-      reg_a = reg_a << 1;
-      set_flags(reg_a);
-      reg_a |= c;
-      status.z = reg_a == 0;
-      return 2;
-
-    case 0x2c:     //  BIT Absolute
-      data = read_absolute(a);
-      run_bit(data);
-      return 4;
-
-    case 0x2d:     //  AND Absolute
-      data = read_absolute(a);
-      run_and(data);
-      return 4;
-
-    case 0x2e:     //  ROR Absolute
-      data = read_absolute(a);
-      run_ror_memory(a, data);
-      return 6;
-
-    case 0x30:     //  BMI
-      offset = read_immediate();
-      a = pc;
-
-      if (status.n == 1)
-      {
-        pc += offset;
-
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0x31:     //  AND (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_and(data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0x35:     //  AND Zero Page, X
-      data = read_zero_page_x(a);
-      run_and(data);
-      return 4;
-
-    case 0x36:     //  ROR Zero Page, X
-      data = read_zero_page_x(a);
-      run_ror_memory(a, data);
-      return 6;
-
-    case 0x38:     //  SEC
-      status.c = 1;
-      return 2;
-
-    case 0x39:     //  AND Absolute, Y
-      data = read_absolute_y(a, b);
-      run_and(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x3d:     //  AND Absolute, X
-      data = read_absolute_x(a, b);
-      run_and(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x3e:     //  ROR Absolute, X
-      data = read_absolute_x(a, b);
-      run_ror_memory(a, data);
-      return 7;
-
-    case 0x40:     //  RTI
-      status.reg_p = pop();
-      pc = pop();
-      pc |= pop() << 8;
-      return 6;
-
-    case 0x41:     //  EOR (Indirect, X)
-      data = read_indirect_x(a);
-      run_eor(data);
-      return 6;
-
-    case 0x45:     //  EOR Zero Page
-      data = read_zero_page(a);
-      run_eor(data);
-      return 3;
-
-    case 0x46:     //  LSR Zero Page
-      data = read_zero_page(a);
-      run_lsr_memory(a, data);
-      return 5;
-
-    case 0x48:     //  PHA
-      push(reg_a);
-      return 3;
-
-    case 0x49:     //  EOR #Immediate
-      data = read_immediate();
-      run_eor(data);
-      return 2;
-
-    case 0x4a:     //  LSR <Accumulator>
-      status.c = (reg_a & 1) != 0;
-      reg_a = (reg_a >> 1) & 0xff;
-      status.z = reg_a == 0;
-      status.n = (reg_a & 0x80) != 0;
-      return 2;
-
-    case 0x4c:     //  JMP Absolute
-      pc = read_address();
-      return 3;
-
-    case 0x4d:     //  EOR Absolute
-      data = read_absolute(a);
-      run_eor(data);
-      return 4;
-
-    case 0x4e:     //  LSR Absolute
-      data = read_absolute(a);
-      run_lsr_memory(a, data);
-      return 6;
-
-    case 0x50:     //  BVC
-      offset = read_immediate();
-      a = pc;
-
-      if (status.v == 0)
-      {
-        pc += offset;
-        // FIXME: Is BVC 3 cycles no matter the page?
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0x51:     //  EOR (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_eor(data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0x55:     //  EOR Zero Page, X
-      data = read_zero_page_x(a);
-      run_eor(data);
-      return 4;
-
-    case 0x56:     //  LSR Zero Page, X
-      data = read_zero_page_x(a);
-      run_lsr_memory(a, data);
-      return 6;
-
-    case 0x58:     //  CLI
-      status.i = 0;
-      return 2;
-
-    case 0x59:     //  EOR Absolute, Y
-      data = read_absolute_y(a, b);
-      run_eor(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x5d:     //  EOR Absolute, X
-      data = read_absolute_x(a, b);
-      run_eor(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x5e:     //  LSR Absolute, X
-      data = read_absolute_x(a, b);
-      run_lsr_memory(a, data);
-      return 7;
-
-    case 0x60:     //  RTS
-      pc = pop();
-      pc |= pop() << 8;
-      return 6;
-
-    case 0x61:     //  ADC (Indirect, X)
-      data = read_indirect_x(a);
-      run_adc(data);
-      return 6;
-
-    case 0x65:     //  ADC ZeroPage
-      data = read_zero_page(a);
-      run_adc(data);
-      return 3;
-
-    case 0x66:     //  ROR Zero Page
-      data = read_zero_page(a);
-      run_ror_memory(a, data);
-      return 5;
-
-    case 0x68:     //  PLA
-      reg_a = pop();
-      return 4;
-
-    case 0x69:     //  ADC #Immediate
-      data = read_immediate();
-      run_adc(data);
-      return 2;
-
-    case 0x6a:     //  ROR <Accumulator>
-      run_ror();
-      return 2;
-
-    case 0x6c:     //  JMP (Indirect)
-      data = read_address();
-      pc = memory_bus->read16(data);
-      return 5;
-
-    case 0x6d:     //  ADC Absolute
-      data = read_absolute(a);
-      run_adc(data);
-      return 4;
-
-    case 0x6e:     //  ROL Absolute
-      data = read_absolute(a);
-      run_rol_memory(a, data);
-      return 6;
-
-    case 0x70:     //  BVS
-      offset = read_immediate();
-      a = pc;
-
-      if (status.v == 1)
-      {
-        pc += offset;
-
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0x71:     //  ADC (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_adc(data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0x75:     //  ADC ZeroPage, X
-      data = read_zero_page_x(a);
-      run_adc(data);
-      return 4;
-
-    case 0x76:     //  ROL Zero Page, X
-      data = read_zero_page_x(a);
-      run_rol_memory(a, data);
-      return 6;
-
-    case 0x78:     //  SEI
-      status.i = 1;
-      return 2;
-
-    case 0x79:     //  ADC Absolute, Y
-      data = read_absolute_y(a, b);
-      run_adc(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x7d:     //  ADC Absolute, X
-      data = read_absolute_x(a, b);
-      run_adc(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0x7e:     //  ROL Absolute, X
-      data = read_absolute_x(a, b);
-      run_rol_memory(a, data);
-      return 7;
-
-    case 0x81:     //  STA (Indirect, X)
-      store_indirect_x(reg_a);
-      return 6;
-
-    case 0x84:     //  STY Zero Page
-      store_zero_page(reg_y);
-      return 3;
-
-    case 0x85:     //  STA Zero Page
-      store_zero_page(reg_a);
-      return 3;
-
-    case 0x86:     //  STX Zero Page
-      store_zero_page(reg_x);
-      return 3;
-
-    case 0x88:     //  DEY <Implied>
-      reg_y = (reg_y - 1) & 0xff;
-      set_load_flags(reg_y);
-      return 2;
-
-    case 0x8a:     //  TXA
-      reg_a = reg_x;
-      set_load_flags(reg_a);
-      return 2;
-
-    case 0x8c:     //  STY Absolute
-      store_absolute(reg_y);
-      return 4;
-
-    case 0x8d:     //  STA Absolute
-      store_absolute(reg_a);
-      return 4;
-
-    case 0x8e:     //  STX Absolute
-      store_absolute(reg_x);
-      return 4;
-
-    case 0x90:     //  BCC
-      offset = read_immediate();
-      a = pc;
-
-      if (status.c == 0)
-      {
-        pc += offset;
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0x91:     //  STA (Indirect), Y
-      store_indirect_y(reg_a);
-      return 6;
-
-    case 0x94:     //  STY Zero Page, X
-      store_zero_page_x(reg_y);
-      return 4;
-
-    case 0x95:     //  STA Zero Page, X
-      store_zero_page_x(reg_a);
-      return 4;
-
-    case 0x96:     //  STX Zero Page, Y
-      store_zero_page_y(reg_x);
-      return 4;
-
-    case 0x98:     //  TYA
-      reg_a = reg_y;
-      set_load_flags(reg_a);
-      return 2;
-
-    case 0x99:     //  STA Absolute, Y
-      store_absolute_y(reg_a, cycles);
-      return 5;
-
-    case 0x9a:     //  TXS
-      sp = reg_x;
-      return 2;
-
-    case 0x9d:     //  STA Absolute, X
-      store_absolute_x(reg_a, cycles);
-      return 5;
-
-    case 0xa0:     //  LDY #Immediate
-      reg_y = read_immediate();
-      set_load_flags(reg_y);
-      return 2;
-
-    case 0xa1:     //  LDA (Indirect, X)
-      data = read_indirect_x(a);
-      reg_a = data;
-      set_load_flags(reg_a);
-      return 6;
-
-    case 0xa2:     //  LDX #Immediate
-      reg_x = read_immediate();
-      set_load_flags(reg_x);
-      return 2;
-
-    case 0xa4:     //  LDY Zero Page
-      reg_y = read_zero_page(a);
-      set_load_flags(reg_y);
-      return 3;
-
-    case 0xa5:     //  LDA Zero Page
-      reg_a = read_zero_page(a);
-      set_load_flags(reg_a);
-      return 3;
-
-    case 0xa6:     //  LDX Zero Page
-      reg_x = read_zero_page(a);
-      set_load_flags(reg_x);
-      return 3;
-
-    case 0xa8:     //  TAY
-      reg_y = reg_a;
-      set_load_flags(reg_y);
-      return 2;
-
-    case 0xa9:     //  LDA #Immediate
-      data = read_immediate();
-      reg_a = data;
-      set_load_flags(reg_a);
-      return 2;
-
-    case 0xaa:     //  TAX
-      reg_x = reg_a;
-      set_load_flags(reg_x);
-      return 2;
-
-    case 0xac:     //  LDY Absolute
-      reg_y = read_absolute(a);
-      set_load_flags(reg_y);
-      return 4;
-
-    case 0xad:     //  LDA Absolute
-      reg_a = read_absolute(a);
-      set_load_flags(reg_a);
-      return 4;
-
-    case 0xae:     //  LDX Absolute
-      reg_x = read_absolute(a);
-      set_load_flags(reg_x);
-      return 4;
-
-    case 0xb0:     //  BCS
-      offset = read_immediate();
-      a = pc;
-
-      if (status.c == 1)
-      {
-        pc += offset;
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0xb1:     //  LDA (Indirect), Y
-      reg_a = read_indirect_y(a, b);
-      set_load_flags(reg_a);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0xb4:     //  LDY Zero Page, X
-      reg_y = read_zero_page_x(a);
-      set_load_flags(reg_y);
-      return 4;
-
-    case 0xb5:     //  LDA Zero Page, X
-      reg_a = read_zero_page_x(a);
-      set_load_flags(reg_a);
-      return 4;
-
-    case 0xb6:     //  LDX Zero Page, Y
-      reg_x = read_zero_page_y();
-      set_load_flags(reg_x);
-      return 4;
-
-    case 0xb8:     //  CLV
-      status.v = 0;
-      return 2;
-
-    case 0xb9:     //  LDA Absolute, Y
-      reg_a = read_absolute_y(a, b);
-      set_load_flags(reg_a);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xba:     //  TSX
-      reg_x = sp;
-      set_flags(reg_x);
-      return 2;
-
-    case 0xbc:     //  LDY Absolute, X
-      reg_y = read_absolute_x(a, b);
-      set_load_flags(reg_y);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xbd:     //  LDA Absolute, X
-      reg_a = read_absolute_x(a, b);
-      set_load_flags(reg_a);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xbe:     //  LDX Absolute, Y
-      reg_x = read_absolute_y(a, b);
-      set_load_flags(reg_x);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xc0:     //  CPY Immediate
-      data = read_immediate();
-      run_compare(reg_y, data);
-      return 2;
-
-    case 0xc1:     //  CMP (Indirect, X)
-      data = read_indirect_x(a);
-      run_compare(reg_a, data);
-      return 6;
-
-    case 0xc4:     //  CPY Zero Page
-      data = read_zero_page(a);
-      run_compare(reg_y, data);
-      return 3;
-
-    case 0xc5:     //  CMP Zero Page
-      data = read_zero_page(a);
-      run_compare(reg_a, data);
-      return 3;
-
-    case 0xc6:     //  DEC Zero Page
-      data = read_zero_page(a);
-      run_dec_memory(a, data);
-      return 5;
-
-    case 0xc8:     //  INY <Implied>
-      reg_y = (reg_y + 1) & 0xff;
-      set_load_flags(reg_y);
-      return 2;
-
-    case 0xc9:     //  CMP #Immediate
-      data = read_immediate();
-      run_compare(reg_a, data);
-      return 3;
-
-    case 0xca:     //  DEX
-      reg_x = (reg_x - 1) & 0xff;
-      set_load_flags(reg_x);
-      return 2;
-
-    case 0xcc:     //  CPY Absolute
-      data = read_absolute(a);
-      run_compare(reg_y, data);
-      return 4;
-
-    case 0xcd:     //  CMP Absolute
-      data = read_absolute(a);
-      run_compare(reg_a, data);
-      return 4;
-
-    case 0xce:     //  DEC Absolute
-      data = read_absolute(a);
-      run_dec_memory(a, data);
-      return 6;
-
-    case 0xd0:     //  BNE
-      offset = read_immediate();
-      a = pc;
-
-      if (status.z == 0)
-      {
-        pc += offset;
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0xd1:     //  CMP (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_compare(reg_a, data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0xd5:     //  CMP Zero Page, X
-      data = read_zero_page_x(a);
-      run_compare(reg_a, data);
-      return 4;
-
-    case 0xd6:     //  DEC Zero Page, X
-      data = read_zero_page_x(a);
-      run_dec_memory(a, data);
-      return 6;
-
-    case 0xd8:     //  CLD
-      status.d = 0;
-      return 2;
-
-    case 0xd9:     //  CMP Absolute, Y
-      data = read_absolute_y(a, b);
-      run_compare(reg_a, data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xdd:     //  CMP Absolute, X
-      data = read_absolute_x(a, b);
-      run_compare(reg_a, data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xde:     //  DEC Absolute, X
-      data = read_absolute_x(a, b);
-      run_dec_memory(a, data);
-      return 7;
-
-    case 0xe0:     //  CPX #Immediate
-      data = read_immediate();
-      run_compare(reg_x, data);
-      return 2;
-
-    case 0xe1:     //  SBC (Indirect, X)
-      data = read_indirect_x(a);
-      run_sbc(data);
-      return 6;
-
-    case 0xe4:     //  CPX Zero Page
-      data = read_zero_page(a);
-      run_compare(reg_x, data);
-      return 3;
-
-    case 0xe5:     //  SBC Zero Page
-      data = read_zero_page(a);
-      run_sbc(data);
-      return 3;
-
-    case 0xe6:     //  INC Zero Page
-      data = read_zero_page(a);
-      run_inc_memory(a, data);
-      return 5;
-
-    case 0xe8:     //  INX (Implied)
-      reg_x = (reg_x + 1) & 0xff;
-      set_load_flags(reg_x);
-      return 2;
-
-    case 0xe9:     //  SBC #Immediate
-      data = read_immediate();
-      run_sbc(data);
-      return 2;
-
-    case 0xea:     //  NOP
-      return 2;
-
-    case 0xec:     //  CPX Absolute
-      data = read_absolute(a);
-      run_compare(reg_x, data);
-      return 4;
-
-    case 0xed:     //  SBC Absolute
-      data = read_absolute(a);
-      run_sbc(data);
-      return 4;
-
-    case 0xee:     //  INC Absolute
-      data = read_absolute(a);
-      run_inc_memory(a, data);
-      return 6;
-
-    case 0xf0:     //  BEQ
-      offset = read_immediate();
-      a = pc;
-
-      if (status.z == 1)
-      {
-        pc += offset;
-        return get_branch_cycles(a);
-      }
-
-      return 2;
-
-    case 0xf1:     //  SBC (Indirect), Y
-      data = read_indirect_y(a, b);
-      run_sbc(data);
-      return same_page(a, b) ? 5 : 6;
-
-    case 0xf5:     //  SBC Zero Page, X
-      data = read_zero_page_x(a);
-      run_sbc(data);
-      return 4;
-
-    case 0xf6:     //  INC Zero Page, X
-      data = read_zero_page_x(a);
-      run_inc_memory(a, data);
-      return 6;
-
-    case 0xf8:     //  SED
-      status.d = 1;
-      return 2;
-
-    case 0xf9:     //  SBC Absolute, Y
-      data = read_absolute_y(a, b);
-      run_sbc(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xfd:     //  SBC Absolute, X
-      data = read_absolute_x(a, b);
-      run_sbc(data);
-      return same_page(a, b) ? 4 : 5;
-
-    case 0xfe:     //  INC Absolute, X
-      data = read_absolute_x(a, b);
-      run_inc_memory(a, data);
-      return 7;
-
-    default:
-      illegal_instruction(opcode);
+    decoded->operand = memory_bus->read(pc + 1);
   }
+    else
+  if (length == 3)
+  {
+    decoded->operand = memory_bus->read16(pc + 1);
+  }
+    else
+  {
+    decoded->operand = 0;
+  }
+
+  if ((pc & 0x1000) == 0) { return decoded; }
+
+  cache_misses++;
+
+  // Don't cache an instruction that wraps past the end of the bank or
+  // that touches the bank switch hotspots at 0x1ff8 / 0x1ff9, since
+  // fetching it again has to go through the MemoryBus.
+  if (offset + length > 0x1000) { return decoded; }
+  if (offset + length > 0xff8 && offset <= 0xff9) { return decoded; }
+
+  DecodedInstruction *entry =
+    decode_cache + (rom->get_bank() << 12) + offset;
+
+  *entry = *decoded;
+
+  return entry;
+}
+
+template<int mode>
+int M6502::op_adc(int operand)
+{
+  int cycles = 0;
+  run_adc(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_and(int operand)
+{
+  int cycles = 0;
+  run_and(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_asl(int operand)
+{
+  if (mode == MODE_ACCUMULATOR)
+  {
+    reg_a <<= 1;
+    set_flags(reg_a);
+    return 0;
+  }
+
+  const int address = get_address<mode>(operand);
+  run_asl_memory(address, memory_bus->read(address));
 
   return 0;
 }
 
+template<int mode>
+int M6502::op_bit(int operand)
+{
+  int cycles = 0;
+  run_bit(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_cmp(int operand)
+{
+  int cycles = 0;
+  run_compare(reg_a, read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_cpx(int operand)
+{
+  int cycles = 0;
+  run_compare(reg_x, read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_cpy(int operand)
+{
+  int cycles = 0;
+  run_compare(reg_y, read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_dec(int operand)
+{
+  const int address = get_address<mode>(operand);
+  run_dec_memory(address, memory_bus->read(address));
+
+  return 0;
+}
+
+template<int mode>
+int M6502::op_eor(int operand)
+{
+  int cycles = 0;
+  run_eor(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_inc(int operand)
+{
+  const int address = get_address<mode>(operand);
+  run_inc_memory(address, memory_bus->read(address));
+
+  return 0;
+}
+
+template<int mode>
+int M6502::op_lda(int operand)
+{
+  int cycles = 0;
+  reg_a = read_data<mode>(operand, cycles);
+  set_load_flags(reg_a);
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_ldx(int operand)
+{
+  int cycles = 0;
+  reg_x = read_data<mode>(operand, cycles);
+  set_load_flags(reg_x);
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_ldy(int operand)
+{
+  int cycles = 0;
+  reg_y = read_data<mode>(operand, cycles);
+  set_load_flags(reg_y);
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_lsr(int operand)
+{
+  if (mode == MODE_ACCUMULATOR)
+  {
+    status.c = (reg_a & 1) != 0;
+    reg_a = (reg_a >> 1) & 0xff;
+    status.z = reg_a == 0;
+    status.n = (reg_a & 0x80) != 0;
+    return 0;
+  }
+
+  const int address = get_address<mode>(operand);
+  run_lsr_memory(address, memory_bus->read(address));
+
+  return 0;
+}
+
+template<int mode>
+int M6502::op_ora(int operand)
+{
+  int cycles = 0;
+  run_or(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_rol(int operand)
+{
+  if (mode == MODE_ACCUMULATOR)
+  {
+    const int c = status.c;
+    reg_a = reg_a << 1;
+    set_flags(reg_a);
+    reg_a |= c;
+    status.z = reg_a == 0;
+    return 0;
+  }
+
+  const int address = get_address<mode>(operand);
+  run_rol_memory(address, memory_bus->read(address));
+
+  return 0;
+}
+
+template<int mode>
+int M6502::op_ror(int operand)
+{
+  if (mode == MODE_ACCUMULATOR)
+  {
+    run_ror();
+    return 0;
+  }
+
+  const int address = get_address<mode>(operand);
+  run_ror_memory(address, memory_bus->read(address));
+
+  return 0;
+}
+
+template<int mode>
+int M6502::op_sbc(int operand)
+{
+  int cycles = 0;
+  run_sbc(read_data<mode>(operand, cycles));
+  return cycles;
+}
+
+template<int mode>
+int M6502::op_sta(int operand)
+{
+  memory_bus->write(get_address<mode>(operand), reg_a);
+  return 0;
+}
+
+template<int mode>
+int M6502::op_stx(int operand)
+{
+  memory_bus->write(get_address<mode>(operand), reg_x);
+  return 0;
+}
+
+template<int mode>
+int M6502::op_sty(int operand)
+{
+  memory_bus->write(get_address<mode>(operand), reg_y);
+  return 0;
+}
+
+int M6502::op_brk(int operand)
+{
+  status.b = 1;
+  stop();
+  return 0;
+}
+
+int M6502::op_dex(int operand)
+{
+  reg_x = (reg_x - 1) & 0xff;
+  set_load_flags(reg_x);
+  return 0;
+}
+
+int M6502::op_dey(int operand)
+{
+  reg_y = (reg_y - 1) & 0xff;
+  set_load_flags(reg_y);
+  return 0;
+}
+
+int M6502::op_inx(int operand)
+{
+  reg_x = (reg_x + 1) & 0xff;
+  set_load_flags(reg_x);
+  return 0;
+}
+
+int M6502::op_iny(int operand)
+{
+  reg_y = (reg_y + 1) & 0xff;
+  set_load_flags(reg_y);
+  return 0;
+}
+
+int M6502::op_jmp_indirect(int operand)
+{
+  pc = memory_bus->read16(operand);
+  return 0;
+}
+
+int M6502::op_jsr(int operand)
+{
+  push(pc >> 8);
+  push(pc & 0xff);
+  pc = operand;
+  return 0;
+}
+
+int M6502::op_rti(int operand)
+{
+  status.reg_p = pop();
+  pc = pop();
+  pc |= pop() << 8;
+  return 0;
+}
+
+int M6502::op_rts(int operand)
+{
+  pc = pop();
+  pc |= pop() << 8;
+  return 0;
+}
+
+int M6502::op_tax(int operand)
+{
+  reg_x = reg_a;
+  set_load_flags(reg_x);
+  return 0;
+}
+
+int M6502::op_tay(int operand)
+{
+  reg_y = reg_a;
+  set_load_flags(reg_y);
+  return 0;
+}
+
+int M6502::op_tsx(int operand)
+{
+  reg_x = sp;
+  set_flags(reg_x);
+  return 0;
+}
+
+int M6502::op_txa(int operand)
+{
+  reg_a = reg_x;
+  set_load_flags(reg_a);
+  return 0;
+}
+
+int M6502::op_tya(int operand)
+{
+  reg_a = reg_y;
+  set_load_flags(reg_a);
+  return 0;
+}
+
+int M6502::op_illegal(int operand)
+{
+  illegal_instruction(memory_bus->read(pc - 1));
+  return 0;
+}
+
+const M6502::Instruction M6502::instructions[256] =
+{
+  { &M6502::op_brk,                        MODE_IMPLIED,     1, 7 }, // 0x00
+  { &M6502::op_ora<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0x01
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x02
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x03
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x04
+  { &M6502::op_ora<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x05
+  { &M6502::op_asl<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0x06
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x07
+  { &M6502::op_php,                        MODE_IMPLIED,     1, 3 }, // 0x08
+  { &M6502::op_ora<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0x09
+  { &M6502::op_asl<MODE_ACCUMULATOR>,      MODE_ACCUMULATOR, 1, 2 }, // 0x0a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x0b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x0c
+  { &M6502::op_ora<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x0d
+  { &M6502::op_asl<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0x0e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x0f
+  { &M6502::op_bpl,                        MODE_RELATIVE,    2, 2 }, // 0x10
+  { &M6502::op_ora<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0x11
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x12
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x13
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x14
+  { &M6502::op_ora<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x15
+  { &M6502::op_asl<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0x16
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x17
+  { &M6502::op_clc,                        MODE_IMPLIED,     1, 2 }, // 0x18
+  { &M6502::op_ora<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0x19
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x1a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x1b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x1c
+  { &M6502::op_ora<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0x1d
+  { &M6502::op_asl<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0x1e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x1f
+  { &M6502::op_jsr,                        MODE_ABSOLUTE,    3, 6 }, // 0x20
+  { &M6502::op_and<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0x21
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x22
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x23
+  { &M6502::op_bit<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x24
+  { &M6502::op_and<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x25
+  { &M6502::op_rol<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0x26
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x27
+  { &M6502::op_plp,                        MODE_IMPLIED,     1, 4 }, // 0x28
+  { &M6502::op_and<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0x29
+  { &M6502::op_rol<MODE_ACCUMULATOR>,      MODE_ACCUMULATOR, 1, 2 }, // 0x2a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x2b
+  { &M6502::op_bit<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x2c
+  { &M6502::op_and<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x2d
+  { &M6502::op_rol<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0x2e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x2f
+  { &M6502::op_bmi,                        MODE_RELATIVE,    2, 2 }, // 0x30
+  { &M6502::op_and<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0x31
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x32
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x33
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x34
+  { &M6502::op_and<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x35
+  { &M6502::op_rol<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0x36
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x37
+  { &M6502::op_sec,                        MODE_IMPLIED,     1, 2 }, // 0x38
+  { &M6502::op_and<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0x39
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x3a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x3b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x3c
+  { &M6502::op_and<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0x3d
+  { &M6502::op_rol<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0x3e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x3f
+  { &M6502::op_rti,                        MODE_IMPLIED,     1, 6 }, // 0x40
+  { &M6502::op_eor<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0x41
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x42
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x43
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x44
+  { &M6502::op_eor<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x45
+  { &M6502::op_lsr<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0x46
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x47
+  { &M6502::op_pha,                        MODE_IMPLIED,     1, 3 }, // 0x48
+  { &M6502::op_eor<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0x49
+  { &M6502::op_lsr<MODE_ACCUMULATOR>,      MODE_ACCUMULATOR, 1, 2 }, // 0x4a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x4b
+  { &M6502::op_jmp,                        MODE_ABSOLUTE,    3, 3 }, // 0x4c
+  { &M6502::op_eor<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x4d
+  { &M6502::op_lsr<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0x4e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x4f
+  { &M6502::op_bvc,                        MODE_RELATIVE,    2, 2 }, // 0x50
+  { &M6502::op_eor<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0x51
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x52
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x53
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x54
+  { &M6502::op_eor<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x55
+  { &M6502::op_lsr<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0x56
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x57
+  { &M6502::op_cli,                        MODE_IMPLIED,     1, 2 }, // 0x58
+  { &M6502::op_eor<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0x59
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x5a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x5b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x5c
+  { &M6502::op_eor<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0x5d
+  { &M6502::op_lsr<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0x5e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x5f
+  { &M6502::op_rts,                        MODE_IMPLIED,     1, 6 }, // 0x60
+  { &M6502::op_adc<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0x61
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x62
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x63
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x64
+  { &M6502::op_adc<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x65
+  { &M6502::op_ror<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0x66
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x67
+  { &M6502::op_pla,                        MODE_IMPLIED,     1, 4 }, // 0x68
+  { &M6502::op_adc<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0x69
+  { &M6502::op_ror<MODE_ACCUMULATOR>,      MODE_ACCUMULATOR, 1, 2 }, // 0x6a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x6b
+  { &M6502::op_jmp_indirect,               MODE_INDIRECT,    3, 5 }, // 0x6c
+  { &M6502::op_adc<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x6d
+  { &M6502::op_ror<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0x6e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x6f
+  { &M6502::op_bvs,                        MODE_RELATIVE,    2, 2 }, // 0x70
+  { &M6502::op_adc<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0x71
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x72
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x73
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x74
+  { &M6502::op_adc<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x75
+  { &M6502::op_ror<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0x76
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x77
+  { &M6502::op_sei,                        MODE_IMPLIED,     1, 2 }, // 0x78
+  { &M6502::op_adc<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0x79
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x7a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x7b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x7c
+  { &M6502::op_adc<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0x7d
+  { &M6502::op_ror<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0x7e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x7f
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x80
+  { &M6502::op_sta<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0x81
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x82
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x83
+  { &M6502::op_sty<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x84
+  { &M6502::op_sta<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x85
+  { &M6502::op_stx<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0x86
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x87
+  { &M6502::op_dey,                        MODE_IMPLIED,     1, 2 }, // 0x88
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x89
+  { &M6502::op_txa,                        MODE_IMPLIED,     1, 2 }, // 0x8a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x8b
+  { &M6502::op_sty<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x8c
+  { &M6502::op_sta<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x8d
+  { &M6502::op_stx<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0x8e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x8f
+  { &M6502::op_bcc,                        MODE_RELATIVE,    2, 2 }, // 0x90
+  { &M6502::op_sta<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 6 }, // 0x91
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x92
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x93
+  { &M6502::op_sty<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x94
+  { &M6502::op_sta<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0x95
+  { &M6502::op_stx<MODE_ZERO_PAGE_Y>,      MODE_ZERO_PAGE_Y, 2, 4 }, // 0x96
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x97
+  { &M6502::op_tya,                        MODE_IMPLIED,     1, 2 }, // 0x98
+  { &M6502::op_sta<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 5 }, // 0x99
+  { &M6502::op_txs,                        MODE_IMPLIED,     1, 2 }, // 0x9a
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x9b
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x9c
+  { &M6502::op_sta<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 5 }, // 0x9d
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x9e
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0x9f
+  { &M6502::op_ldy<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xa0
+  { &M6502::op_lda<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0xa1
+  { &M6502::op_ldx<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xa2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xa3
+  { &M6502::op_ldy<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xa4
+  { &M6502::op_lda<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xa5
+  { &M6502::op_ldx<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xa6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xa7
+  { &M6502::op_tay,                        MODE_IMPLIED,     1, 2 }, // 0xa8
+  { &M6502::op_lda<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xa9
+  { &M6502::op_tax,                        MODE_IMPLIED,     1, 2 }, // 0xaa
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xab
+  { &M6502::op_ldy<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xac
+  { &M6502::op_lda<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xad
+  { &M6502::op_ldx<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xae
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xaf
+  { &M6502::op_bcs,                        MODE_RELATIVE,    2, 2 }, // 0xb0
+  { &M6502::op_lda<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0xb1
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xb2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xb3
+  { &M6502::op_ldy<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0xb4
+  { &M6502::op_lda<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0xb5
+  { &M6502::op_ldx<MODE_ZERO_PAGE_Y>,      MODE_ZERO_PAGE_Y, 2, 4 }, // 0xb6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xb7
+  { &M6502::op_clv,                        MODE_IMPLIED,     1, 2 }, // 0xb8
+  { &M6502::op_lda<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0xb9
+  { &M6502::op_tsx,                        MODE_IMPLIED,     1, 2 }, // 0xba
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xbb
+  { &M6502::op_ldy<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0xbc
+  { &M6502::op_lda<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0xbd
+  { &M6502::op_ldx<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0xbe
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xbf
+  { &M6502::op_cpy<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xc0
+  { &M6502::op_cmp<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0xc1
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xc2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xc3
+  { &M6502::op_cpy<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xc4
+  { &M6502::op_cmp<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xc5
+  { &M6502::op_dec<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0xc6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xc7
+  { &M6502::op_iny,                        MODE_IMPLIED,     1, 2 }, // 0xc8
+  { &M6502::op_cmp<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xc9
+  { &M6502::op_dex,                        MODE_IMPLIED,     1, 2 }, // 0xca
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xcb
+  { &M6502::op_cpy<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xcc
+  { &M6502::op_cmp<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xcd
+  { &M6502::op_dec<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0xce
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xcf
+  { &M6502::op_bne,                        MODE_RELATIVE,    2, 2 }, // 0xd0
+  { &M6502::op_cmp<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0xd1
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xd2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xd3
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xd4
+  { &M6502::op_cmp<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0xd5
+  { &M6502::op_dec<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0xd6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xd7
+  { &M6502::op_cld,                        MODE_IMPLIED,     1, 2 }, // 0xd8
+  { &M6502::op_cmp<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0xd9
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xda
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xdb
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xdc
+  { &M6502::op_cmp<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0xdd
+  { &M6502::op_dec<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0xde
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xdf
+  { &M6502::op_cpx<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xe0
+  { &M6502::op_sbc<MODE_INDIRECT_X>,       MODE_INDIRECT_X,  2, 6 }, // 0xe1
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xe2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xe3
+  { &M6502::op_cpx<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xe4
+  { &M6502::op_sbc<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 3 }, // 0xe5
+  { &M6502::op_inc<MODE_ZERO_PAGE>,        MODE_ZERO_PAGE,   2, 5 }, // 0xe6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xe7
+  { &M6502::op_inx,                        MODE_IMPLIED,     1, 2 }, // 0xe8
+  { &M6502::op_sbc<MODE_IMMEDIATE>,        MODE_IMMEDIATE,   2, 2 }, // 0xe9
+  { &M6502::op_nop,                        MODE_IMPLIED,     1, 2 }, // 0xea
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xeb
+  { &M6502::op_cpx<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xec
+  { &M6502::op_sbc<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 4 }, // 0xed
+  { &M6502::op_inc<MODE_ABSOLUTE>,         MODE_ABSOLUTE,    3, 6 }, // 0xee
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xef
+  { &M6502::op_beq,                        MODE_RELATIVE,    2, 2 }, // 0xf0
+  { &M6502::op_sbc<MODE_INDIRECT_Y>,       MODE_INDIRECT_Y,  2, 5 }, // 0xf1
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xf2
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xf3
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xf4
+  { &M6502::op_sbc<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 4 }, // 0xf5
+  { &M6502::op_inc<MODE_ZERO_PAGE_X>,      MODE_ZERO_PAGE_X, 2, 6 }, // 0xf6
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xf7
+  { &M6502::op_sed,                        MODE_IMPLIED,     1, 2 }, // 0xf8
+  { &M6502::op_sbc<MODE_ABSOLUTE_Y>,       MODE_ABSOLUTE_Y,  3, 4 }, // 0xf9
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xfa
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xfb
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xfc
+  { &M6502::op_sbc<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 4 }, // 0xfd
+  { &M6502::op_inc<MODE_ABSOLUTE_X>,       MODE_ABSOLUTE_X,  3, 7 }, // 0xfe
+  { &M6502::op_illegal,                    MODE_IMPLIED,     1, 0 }, // 0xff
+};
@@ -23,7 +23,62 @@
 
 class M6502
 {
+private:
+  enum
+  {
+    MODE_IMPLIED,
+    MODE_ACCUMULATOR,
+    MODE_IMMEDIATE,
+    MODE_ZERO_PAGE,
+    MODE_ZERO_PAGE_X,
+    MODE_ZERO_PAGE_Y,
+    MODE_ABSOLUTE,
+    MODE_ABSOLUTE_X,
+    MODE_ABSOLUTE_Y,
+    MODE_INDIRECT,
+    MODE_INDIRECT_X,
+    MODE_INDIRECT_Y,
+    MODE_RELATIVE,
+  };
+
+  // Every opcode has an entry in the instructions[] table. step() reads
+  // the opcode and its operand bytes (length includes the opcode) and
+  // calls the handler, which returns any cycles taken beyond the base
+  // cycle count (page crossing, branches taken).
+  typedef int (M6502::*Handler)(int operand);
+
+  struct Instruction
+  {
+    Handler handler;
+    uint8_t mode;
+    uint8_t length;
+    uint8_t cycles;
+  };
+
+  static const Instruction instructions[256];
+
+  // Instructions fetched from ROM are decoded once and kept in a cache
+  // with one entry per byte of each 4k bank. Since a bank's contents
+  // never change, switching banks only selects a different table.
+  struct DecodedInstruction
+  {
+    const Instruction *instruction;
+    int operand;
+  };
+
 public:
+  // The registers, for SnapshotCache.
+  struct State
+  {
+    uint64_t total_cycles;
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t reg_a;
+    uint8_t reg_x;
+    uint8_t reg_y;
+    uint8_t reg_p;
+  };
+
   M6502();
   ~M6502();
 
@@ -32,99 +87,184 @@ public:
   void set_breakpoint(int value) { breakpoint = value; }
   void stop() { running = false; }
   void reset();
+  void save_state(State &state);
+  void load_state(const State &state);
   void dump();
+  void dump_cache_stats();
   void illegal_instruction(uint8_t opcode);
   bool is_running() { return running; }
-  void clock(int ticks = 1) { total_cycles += ticks; }
+  uint64_t get_total_cycles() { return total_cycles; }
   int get_pc() { return pc; }
-  int step();
-
-private:
-  int execute_instruction();
+  int step_debug();
 
-  int read_immediate()
+  int step()
   {
-    return memory_bus->read(pc++);
-  }
+    const DecodedInstruction *decoded;
 
-  int read_address()
-  {
-    int m = memory_bus->read16(pc);
-    pc += 2;
-    return m;
-  }
+    if ((pc & 0x1000) != 0)
+    {
+      decoded = decode_cache + (rom->get_bank() << 12) + (pc & 0x0fff);
 
-  int read_absolute(int &address)
-  {
-    int m = memory_bus->read16(pc);
-    address = m;
-    pc += 2;
-    return memory_bus->read(m);
-  }
+      if (decoded->instruction == nullptr)
+      {
+        decoded = decode();
+      }
+        else
+      {
+        cache_hits++;
+      }
+    }
+      else
+    {
+      decoded = decode();
+    }
 
-  int read_zero_page(int &address)
-  {
-    int m = memory_bus->read(pc++);
-    address = m;
-    return memory_bus->read(m);
-  }
+    const Instruction &instruction = *decoded->instruction;
+    const int operand = decoded->operand;
 
-  int read_absolute_x(int &address, int &address_before)
-  {
-    int m = memory_bus->read16(pc);
-    address_before = m;
-    m += reg_x;
-    address = m;
-    pc += 2;
-    return memory_bus->read(m);
-  }
+    // The bus accesses of an instruction are treated as happening at the
+    // end of its base cycle count, which is when stores happen.
+    memory_bus->set_cycle(total_cycles + instruction.cycles);
 
-  int read_absolute_y(int &address, int &address_before)
-  {
-    int m = memory_bus->read16(pc);
-    address_before = m;
-    m += reg_y;
-    address = m;
-    pc += 2;
-    return memory_bus->read(m);
-  }
+    pc += instruction.length;
 
-  int read_indirect_x(int &address)
-  {
-    int m;
-    m = memory_bus->read(pc++) + reg_x;
-    m = memory_bus->read16(m & 0xff);
-    address = m;
-    return memory_bus->read(m);
+    int cycles = instruction.cycles + (this->*instruction.handler)(operand);
+
+    total_cycles += cycles;
+    total_instructions++;
+
+    // A write to WSYNC halts the CPU until the start of the next scanline.
+    const uint64_t stall_until = memory_bus->get_stall_until();
+
+    if (stall_until > total_cycles)
+    {
+      cycles += stall_until - total_cycles;
+      total_cycles = stall_until;
+    }
+
+    return cycles;
   }
 
-  int read_indirect_y(int &address, int &address_before)
+private:
+  const DecodedInstruction *decode();
+
+  template<int mode>
+  int get_address(int operand)
   {
-    int m;
-    m = memory_bus->read(pc++);
-    m = memory_bus->read16(m);
-    address_before = m;
-    m += reg_y;
-    m = m & 0xffff;
-    address = m;
-    return memory_bus->read(m);
+    switch (mode)
+    {
+      case MODE_ZERO_PAGE_X:
+        return (operand + reg_x) & 0xff;
+      case MODE_ZERO_PAGE_Y:
+        return (operand + reg_y) & 0xff;
+      case MODE_ABSOLUTE_X:
+        return (operand + reg_x) & 0xffff;
+      case MODE_ABSOLUTE_Y:
+        return (operand + reg_y) & 0xffff;
+      case MODE_INDIRECT_X:
+        return memory_bus->read16((operand + reg_x) & 0xff);
+      case MODE_INDIRECT_Y:
+        return (memory_bus->read16(operand) + reg_y) & 0xffff;
+      default:
+        return operand;
+    }
   }
 
-  int read_zero_page_x(int &address)
+  // Reads the data for an instruction and adds 1 to cycles if an indexed
+  // read crosses a page boundary.
+  template<int mode>
+  int read_data(int operand, int &cycles)
   {
-    int m;
-    m = memory_bus->read(pc++) + reg_x;
-    m = m & 0xff;
-    address = m;
-    return memory_bus->read(m);
+    int address;
+
+    switch (mode)
+    {
+      case MODE_IMMEDIATE:
+        return operand;
+      case MODE_ABSOLUTE_X:
+      case MODE_ABSOLUTE_Y:
+        address = get_address<mode>(operand);
+        cycles += !same_page(address, operand);
+        return memory_bus->read(address);
+      case MODE_INDIRECT_Y:
+        operand = memory_bus->read16(operand);
+        address = (operand + reg_y) & 0xffff;
+        cycles += !same_page(address, operand);
+        return memory_bus->read(address);
+      default:
+        return memory_bus->read(get_address<mode>(operand));
+    }
   }
 
-  int read_zero_page_y()
-  {
-    int m;
-    m = memory_bus->read(pc++) + reg_y;
-    m = m & 0xff;
-    return memory_bus->read(m);
+  template<int mode> int op_adc(int operand);
+  template<int mode> int op_and(int operand);
+  template<int mode> int op_asl(int operand);
+  template<int mode> int op_bit(int operand);
+  template<int mode> int op_cmp(int operand);
+  template<int mode> int op_cpx(int operand);
+  template<int mode> int op_cpy(int operand);
+  template<int mode> int op_dec(int operand);
+  template<int mode> int op_eor(int operand);
+  template<int mode> int op_inc(int operand);
+  template<int mode> int op_lda(int operand);
+  template<int mode> int op_ldx(int operand);
+  template<int mode> int op_ldy(int operand);
+  template<int mode> int op_lsr(int operand);
+  template<int mode> int op_ora(int operand);
+  template<int mode> int op_rol(int operand);
+  template<int mode> int op_ror(int operand);
+  template<int mode> int op_sbc(int operand);
+  template<int mode> int op_sta(int operand);
+  template<int mode> int op_stx(int operand);
+  template<int mode> int op_sty(int operand);
+
+  int op_bcc(int operand) { return branch(status.c == 0, operand); }
+  int op_bcs(int operand) { return branch(status.c == 1, operand); }
+  int op_beq(int operand) { return branch(status.z == 1, operand); }
+  int op_bmi(int operand) { return branch(status.n == 1, operand); }
+  int op_bne(int operand) { return branch(status.z == 0, operand); }
+  int op_bpl(int operand) { return branch(status.n == 0, operand); }
+  int op_bvc(int operand) { return branch(status.v == 0, operand); }
+  int op_bvs(int operand) { return branch(status.v == 1, operand); }
+
+  int op_brk(int operand);
+  int op_clc(int operand) { status.c = 0; return 0; }
+  int op_cld(int operand) { status.d = 0; return 0; }
+  int op_cli(int operand) { status.i = 0; return 0; }
+  int op_clv(int operand) { status.v = 0; return 0; }
+  int op_dex(int operand);
+  int op_dey(int operand);
+  int op_inx(int operand);
+  int op_iny(int operand);
+  int op_jmp(int operand) { pc = operand; return 0; }
+  int op_jmp_indirect(int operand);
+  int op_jsr(int operand);
+  int op_nop(int operand) { return 0; }
+  int op_pha(int operand) { push(reg_a); return 0; }
+  int op_php(int operand) { push(status.reg_p); return 0; }
+  int op_pla(int operand) { reg_a = pop(); return 0; }
+  int op_plp(int operand) { status.reg_p = pop(); return 0; }
+  int op_rti(int operand);
+  int op_rts(int operand);
+  int op_sec(int operand) { status.c = 1; return 0; }
+  int op_sed(int operand) { status.d = 1; return 0; }
+  int op_sei(int operand) { status.i = 1; return 0; }
+  int op_tax(int operand);
+  int op_tay(int operand);
+  int op_tsx(int operand);
+  int op_txa(int operand);
+  int op_txs(int operand) { sp = reg_x; return 0; }
+  int op_tya(int operand);
+  int op_illegal(int operand);
+
+  int branch(bool condition, int operand)
+  {
+    if (!condition) { return 0; }
+
+    const int address = pc;
+    pc += (int8_t)operand;
+
+    return get_branch_cycles(address) - 2;
   }
 
   void set_flags(int &data)
@@ -242,7 +382,7 @@ private:
 
   void run_or(int data)
   {
-    reg_a = reg_a ^ data;
+    reg_a = reg_a | data;
     set_load_flags(reg_a);
   }
 
@@ -328,67 +468,6 @@ private:
     return (pc >> 8) == (address >> 8) ? 3 : 4;
   }
 
-  void store_absolute(int data)
-  {
-    int address = memory_bus->read16(pc);
-    pc += 2;
-    memory_bus->write(address, data);
-  }
-
-  void store_absolute_x(int data, int &cycles)
-  {
-    int a = memory_bus->read16(pc);
-    cycles = 5;
-    int address = a + reg_x;
-    //if (!same_page(address, a)) { cycles++; }
-    pc += 2;
-    memory_bus->write(address, data);
-  }
-
-  void store_absolute_y(int data, int &cycles)
-  {
-    int a = memory_bus->read16(pc);
-    cycles = 5;
-    int address = a + reg_y;
-    //if (!same_page(address, a)) { cycles++; }
-    pc += 2;
-    memory_bus->write(address, data);
-  }
-
-  void store_zero_page(int data)
-  {
-    int address = memory_bus->read(pc++);
-    memory_bus->write(address, data);
-  }
-
-  void store_zero_page_x(int data)
-  {
-    int address = memory_bus->read(pc++) + reg_x;
-    memory_bus->write(address, data);
-  }
-
-  void store_zero_page_y(int data)
-  {
-    int address = memory_bus->read(pc++) + reg_x;
-    memory_bus->write(address, data);
-  }
-
-  void store_indirect_x(int data)
-  {
-    int address;
-    address = memory_bus->read(pc++) + reg_x;
-    address = memory_bus->read16(address & 0xff);
-    memory_bus->write(address, data);
-  }
-
-  void store_indirect_y(int data)
-  {
-    int address;
-    address = memory_bus->read(pc++);
-    address = memory_bus->read16(address) + reg_y;
-    memory_bus->write(address, data);
-  }
-
   bool same_page(int address)
   {
     return (pc >> 8) == (address >> 8);
@@ -400,12 +479,17 @@ private:
   }
 
   MemoryBus *memory_bus;
+  ROM *rom;
+  DecodedInstruction *decode_cache;
+  DecodedInstruction decode_scratch;
+  uint64_t cache_hits;
+  uint64_t cache_misses;
   bool running;
 
   int reg_a, reg_x, reg_y;
   uint16_t pc, sp;
-  uint32_t total_cycles;
-  uint32_t total_instructions;
+  uint64_t total_cycles;
+  uint64_t total_instructions;
   int breakpoint;
   bool debug;
 
@@ -0,0 +1,117 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Machine.h"
+
+Machine::Machine() :
+  pool{nullptr},
+  pool_size{0}
+{
+  m6502 = new M6502();
+  memory_bus = new MemoryBus();
+  rom = new ROM();
+  television = new TelevisionNull();
+}
+
+Machine::~Machine()
+{
+  delete television;
+  delete m6502;
+  delete rom;
+  delete memory_bus;
+
+  free(pool);
+}
+
+int Machine::init(const char *filename, int pool_size)
+{
+  if (rom->load(filename) != 0) { return -1; }
+
+  memory_bus->init();
+  memory_bus->set_rom(rom);
+  m6502->set_memory_bus(memory_bus);
+  m6502->reset();
+
+  if (television->init() != 0) { return -1; }
+
+  memory_bus->get_tia()->set_television(television);
+
+  if (pool_size < 1) { pool_size = 1; }
+
+  if (posix_memalign((void **)&pool, alignof(Slot),
+        sizeof(Slot) * pool_size) != 0)
+  {
+    printf("Error: Couldn't allocate %d save states\n", pool_size);
+    pool = nullptr;
+    return -1;
+  }
+
+  // Slots that were never saved are refused by restore().
+  memset((void *)pool, 0, sizeof(Slot) * pool_size);
+
+  this->pool_size = pool_size;
+
+  return 0;
+}
+
+bool Machine::run_frame()
+{
+  // Returns false if the game stopped.
+  TIA *tia = memory_bus->get_tia();
+  const uint64_t end = m6502->get_total_cycles() + MAX_FRAME_CYCLES;
+  const int frame = television->get_frame_count();
+
+  while (m6502->is_running() && m6502->get_total_cycles() < end)
+  {
+    m6502->step();
+
+    // Input only comes from handle_event().
+    tia->need_check_events();
+
+    if (television->get_frame_count() != frame) { return true; }
+  }
+
+  return m6502->is_running();
+}
+
+int Machine::save(int slot)
+{
+  if (slot < 0 || slot >= pool_size) { return -1; }
+
+  SaveState::save(m6502, memory_bus, pool[slot].image);
+
+  return 0;
+}
+
+int Machine::restore(int slot)
+{
+  if (slot < 0 || slot >= pool_size) { return -1; }
+
+  return SaveState::restore(m6502, memory_bus, pool[slot].image);
+}
+
+int Machine::clone(int to, int from)
+{
+  if (to < 0 || to >= pool_size || from < 0 || from >= pool_size)
+  {
+    return -1;
+  }
+
+  memcpy(&pool[to], &pool[from], sizeof(Slot));
+
+  return 0;
+}
+
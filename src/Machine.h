@@ -0,0 +1,73 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * Machine is a whole Atari 2600 with no display, for programs that try
+ * a game many times from the same places, like a tree search or an
+ * agent learning to play that resets after each try.
+ *
+ * Next to the emulator it keeps a pool of SaveState::Images, allocated
+ * once in init() as one block with each Image on its own cache lines.
+ * save() copies the running game into a slot and restore() puts a slot
+ * back. clone() copies one slot to another with a single memcpy, so
+ * branching a search doesn't touch the emulator at all.
+ *
+ * The emulator's own objects point at each other and the ROM, so they
+ * aren't copied as they are. Only what can change goes in the Images.
+ *
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+
+#include "M6502.h"
+#include "MemoryBus.h"
+#include "ROM.h"
+#include "SaveState.h"
+#include "TelevisionNull.h"
+
+class Machine
+{
+public:
+  Machine();
+  ~Machine();
+
+  int init(const char *filename, int pool_size);
+  bool run_frame();
+  void handle_event(int event) { memory_bus->handle_event(event); }
+
+  int save(int slot);
+  int restore(int slot);
+  int clone(int to, int from);
+
+  int get_pool_size() { return pool_size; }
+  const SaveState::Image *get_image(int slot) { return &pool[slot].image; }
+  uint8_t *get_frame() { return television->get_frame(); }
+
+private:
+  struct alignas(64) Slot
+  {
+    SaveState::Image image;
+  };
+
+  // If the game doesn't finish a frame in this many CPU cycles (4 frames)
+  // run_frame() gives up.
+  static const int MAX_FRAME_CYCLES = 76 * 262 * 4;
+
+  M6502 *m6502;
+  MemoryBus *memory_bus;
+  ROM *rom;
+  TelevisionNull *television;
+  Slot *pool;
+  int pool_size;
+};
+
+#endif
+
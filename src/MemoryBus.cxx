@@ -16,10 +16,16 @@
 #include "RIOT.h"
 #include "TIA.h"
 
-MemoryBus::MemoryBus() : rom{nullptr}
+MemoryBus::MemoryBus() :
+  cycle{0},
+  stall_until{0},
+  input_read{false},
+  rom{nullptr}
 {
   tia = new TIA();
   riot = new RIOT();
+
+  map_pages();
 }
 
 MemoryBus::~MemoryBus()
@@ -28,14 +34,54 @@ MemoryBus::~MemoryBus()
   delete riot;
 }
 
+void MemoryBus::set_rom(ROM *rom)
+{
+  this->rom = rom;
+
+  map_pages();
+}
+
 void MemoryBus::init()
 {
   tia->reset();
 }
 
-uint8_t MemoryBus::read(int address)
+void MemoryBus::map_pages()
+{
+  uint8_t *ram = riot->get_ram();
+
+  for (int n = 0; n < PAGE_COUNT; n++)
+  {
+    const int address = n << PAGE_SHIFT;
+
+    read_pages[n] = nullptr;
+    write_pages[n] = nullptr;
+
+    if ((address & 0x1000) == 0x1000)
+    {
+      if (rom == nullptr) { continue; }
+
+      // With more than 1 bank, reading 0x1ff8 / 0x1ff9 switches banks.
+      if (rom->get_bank_count() > 1 && (address & 0x0fff) == 0x0fc0)
+      {
+        continue;
+      }
+
+      read_pages[n] = rom->get_memory() + (address & 0x0fff);
+      write_pages[n] = rom_sink;
+    }
+      else
+    if ((address & 0x0280) == 0x0080)
+    {
+      // RAM is at 0x80 to 0xff mirrored anywhere A7 is set and A9 isn't.
+      read_pages[n] = ram + (address & 0x00c0);
+      write_pages[n] = ram + (address & 0x00c0);
+    }
+  }
+}
+
+uint8_t MemoryBus::read_io(int address)
 {
-  // Takes care of mirrored memory.
   if ((address & 0x1000) == 0x1000)
   {
     if (address == 0x1ff9)
@@ -51,28 +97,39 @@ uint8_t MemoryBus::read(int address)
     return rom->read_int8(address & 0x0fff);
   }
 
-  if (address <= 0x3f)
+  // TIA is selected when A7 is clear and only decodes A0 to A3 on reads.
+  // 0x08 to 0x0d are the paddles and fire buttons.
+  if ((address & 0x0080) == 0)
   {
-    return tia->read_memory(address & 0x3f);
+    if ((address & 0x08) != 0) { input_read = true; }
+
+    tia->sync(cycle);
+    return tia->read_memory(address & 0x0f);
   }
 
-  return riot->read_memory(address);
+  // SWCHA (joysticks) and SWCHB (switches). A9 is clear for the RAM.
+  if ((address & 0x0205) == 0x0200) { input_read = true; }
+
+  riot->sync(cycle);
+  return riot->read_memory(address & 0x02ff);
 }
 
-void MemoryBus::write(int address, uint8_t value)
+void MemoryBus::write_io(int address, uint8_t value)
 {
   if ((address & 0x1000) == 0x1000)
   {
   }
     else
-  if (address <= 0x3f)
-  { 
+  if ((address & 0x0080) == 0)
+  {
+    tia->sync(cycle);
     tia->write_memory(address & 0x3f, value);
-  } 
+    stall_until = tia->get_stall_until();
+  }
     else
-  if ((address & 0x1000) == 0x0000)
-  { 
-    riot->write_memory(address, value);
+  {
+    riot->sync(cycle);
+    riot->write_memory(address & 0x02ff, value);
   }
 }
 
@@ -103,9 +160,98 @@ void MemoryBus::dump(int start, int end)
   printf("\n");
 }
 
-void MemoryBus::clock(int cycles)
+void MemoryBus::sync(uint64_t cycle)
+{
+  tia->sync(cycle);
+  riot->sync(cycle);
+}
+
+void MemoryBus::reset_cycle()
+{
+  cycle = 0;
+  stall_until = 0;
+
+  tia->reset_cycle();
+  riot->reset_cycle();
+}
+
+void MemoryBus::save_state(State &state)
+{
+  state.cycle = cycle;
+  state.stall_until = stall_until;
+  state.bank = rom->get_bank();
+
+  riot->save_state(state.riot);
+  tia->save_state(state.tia);
+}
+
+void MemoryBus::load_state(const State &state)
 {
-  tia->clock(cycles);
-  riot->clock(cycles);
+  cycle = state.cycle;
+  stall_until = state.stall_until;
+
+  // The pages point at the ROM's copy of the bank, so they don't change.
+  // Switching banks copies 4k, so it's skipped if it's already there.
+  if (state.bank != rom->get_bank()) { rom->set_bank(state.bank); }
+
+  riot->load_state(state.riot);
+  tia->load_state(state.tia);
+}
+
+bool MemoryBus::check_state(const State &state)
+{
+  // The bank is where set_bank() copies from.
+  if (state.bank < 0 || state.bank >= rom->get_bank_count()) { return false; }
+
+  return riot->check_state(state.riot) && tia->check_state(state.tia);
+}
+
+void MemoryBus::handle_event(int event)
+{
+  switch (event)
+  {
+    case Television::KEY_SELECT_DOWN:
+      riot->set_switch_select();
+      break;
+    case Television::KEY_SELECT_UP:
+      riot->clear_switch_select();
+      break;
+    case Television::KEY_RESET_DOWN:
+      riot->set_switch_reset();
+      break;
+    case Television::KEY_RESET_UP:
+      riot->clear_switch_reset();
+      break;
+    case Television::KEY_LEFT_DOWN:
+      riot->set_joystick_0_left();
+      break;
+    case Television::KEY_LEFT_UP:
+      riot->clear_joystick_0_left();
+      break;
+    case Television::KEY_RIGHT_DOWN:
+      riot->set_joystick_0_right();
+      break;
+    case Television::KEY_RIGHT_UP:
+      riot->clear_joystick_0_right();
+      break;
+    case Television::KEY_UP_DOWN:
+      riot->set_joystick_0_up();
+      break;
+    case Television::KEY_UP_UP:
+      riot->clear_joystick_0_up();
+      break;
+    case Television::KEY_DOWN_DOWN:
+      riot->set_joystick_0_down();
+      break;
+    case Television::KEY_DOWN_UP:
+      riot->clear_joystick_0_down();
+      break;
+    case Television::KEY_FIRE_DOWN:
+      tia->set_joystick_0_fire();
+      break;
+    case Television::KEY_FIRE_UP:
+      tia->clear_joystick_0_fire();
+      break;
+  }
 }
 
@@ -11,6 +11,20 @@
  * meaning TIA, RIOT, ROM, etc. This object deals with the unfortunate
  * memory mirroring that happens in the Atari 2600.
  *
+ * The 6507 only has 13 address lines, so the 8k address space is split
+ * into 64 byte pages. RAM and ROM pages point directly at the memory
+ * behind them so a read or write is a single lookup. Pages with a NULL
+ * pointer (TIA, RIOT I/O, and the bank switch hotspots) go through
+ * read_io() / write_io().
+ *
+ * M6502 sets the CPU cycle of each instruction's bus accesses with
+ * set_cycle(). The TIA and RIOT are only caught up to that cycle when one
+ * of their registers is accessed, so nothing is clocked per instruction.
+ *
+ * handle_event() sets the switches and joystick from a Television key
+ * event. was_input_read() says if the game has looked at them (or the
+ * paddles) since clear_input_read().
+ *
  */
 
 #ifndef MEMORY_BUS_H
@@ -23,24 +37,87 @@
 class MemoryBus
 {
 public:
+  // The state of everything on the bus, for SnapshotCache.
+  struct State
+  {
+    uint64_t cycle;
+    uint64_t stall_until;
+    int32_t bank;
+    RIOT::State riot;
+    TIA::State tia;
+  };
+
   MemoryBus();
   ~MemoryBus();
 
-  void set_rom(ROM *rom) { this->rom = rom; }
+  void set_rom(ROM *rom);
   void init();
-  uint8_t read(int address);
-  void write(int address, uint8_t value);
   void dump(int start, int end);
-  void clock(int cycles);
+  void set_cycle(uint64_t cycle) { this->cycle = cycle; }
+  void sync(uint64_t cycle);
+  void reset_cycle();
+  void handle_event(int event);
+  void save_state(State &state);
+  void load_state(const State &state);
+  bool check_state(const State &state);
+  void clear_input_read() { input_read = false; }
+  bool was_input_read() { return input_read; }
+  uint64_t get_stall_until() { return stall_until; }
+  ROM *get_rom() { return rom; }
   RIOT *get_riot() { return riot; }
   TIA *get_tia() { return tia; }
 
+  uint8_t read(int address)
+  {
+    address &= 0x1fff;
+
+    const uint8_t *page = read_pages[address >> PAGE_SHIFT];
+
+    if (page != nullptr) { return page[address & PAGE_MASK]; }
+
+    return read_io(address);
+  }
+
+  void write(int address, uint8_t value)
+  {
+    address &= 0x1fff;
+
+    uint8_t *page = write_pages[address >> PAGE_SHIFT];
+
+    if (page != nullptr)
+    {
+      page[address & PAGE_MASK] = value;
+      return;
+    }
+
+    write_io(address, value);
+  }
+
   uint16_t read16(int address)
   {
     return read(address) | (read(address + 1) << 8);
   }
 
 private:
+  static const int PAGE_SHIFT = 6;
+  static const int PAGE_SIZE = 1 << PAGE_SHIFT;
+  static const int PAGE_MASK = PAGE_SIZE - 1;
+  static const int PAGE_COUNT = 0x2000 >> PAGE_SHIFT;
+
+  void map_pages();
+  uint8_t read_io(int address);
+  void write_io(int address, uint8_t value);
+
+  const uint8_t *read_pages[PAGE_COUNT];
+  uint8_t *write_pages[PAGE_COUNT];
+
+  // Writes to ROM are thrown away here.
+  uint8_t rom_sink[PAGE_SIZE];
+
+  uint64_t cycle;
+  uint64_t stall_until;
+  bool input_read;
+
   ROM *rom;
   RIOT *riot;
   TIA *tia;
@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
@@ -25,21 +26,79 @@
 Network::Network() :
   socket_id{-1},
   client{-1},
-  port{5900}
+  port{5900},
+  epoll_fd{-1},
+  handoff_length{0},
+  handoff_mode{HANDOFF_NONE}
 {
+  wake_pipe[0] = -1;
+  wake_pipe[1] = -1;
+
+  memset(socket_path, 0, sizeof(socket_path));
+
+  // Nothing here is left open in a process started with exec, so a
+  // ProcessPool's games only get the descriptor they're given.
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (epoll_fd == -1)
+  {
+    perror("Can't create epoll");
+    return;
+  }
+
+  if (pipe2(wake_pipe, O_CLOEXEC) != 0)
+  {
+    wake_pipe[0] = -1;
+    wake_pipe[1] = -1;
+    return;
+  }
+
+  fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+  net_watch(wake_pipe[0]);
 }
 
 Network::~Network()
 {
   net_close();
+
+  if (wake_pipe[0] != -1)
+  {
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+  }
+
+  if (epoll_fd != -1) { close(epoll_fd); }
 }
 
 int Network::net_open(int port)
 {
-  struct sockaddr_in server_addr;
   struct sockaddr_in client_addr;
 
-  socket_id = socket(AF_INET, SOCK_STREAM, 0);
+  if (net_listen(port) != 0) { return -1; }
+
+  socklen_t n = sizeof(client_addr);
+
+  client = accept4(
+    socket_id,
+    (struct sockaddr *)&client_addr,
+    &n,
+    SOCK_CLOEXEC);
+
+  if (client == -1) { return -1; }
+
+  fcntl(client, F_SETFL, O_NONBLOCK);
+  set_send_buffer(client);
+
+  return 0;
+}
+
+int Network::net_listen(int port)
+{
+  struct sockaddr_in server_addr;
+
+  socket_id = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
 
   if (socket_id < 0)
   {
@@ -47,6 +106,12 @@ int Network::net_open(int port)
     return -1;
   }
 
+  // The server modes are restarted while old connections are still in
+  // TIME_WAIT, which would otherwise keep the port from being bound.
+  const int reuse = 1;
+
+  setsockopt(socket_id, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
   memset((char*)&server_addr, 0, sizeof(server_addr));
   server_addr.sin_family = AF_INET;
   server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -58,19 +123,83 @@ int Network::net_open(int port)
     return -1;
   }
 
-  if (listen(socket_id, 1) != 0)
+  if (listen(socket_id, SOMAXCONN) != 0)
   {
     printf("Listen failed.\n");
     return -1;
   }
 
-  socklen_t n = sizeof(client_addr);
+  return 0;
+}
+
+int Network::net_open(const char *path)
+{
+  if (net_listen(path) != 0) { return -1; }
 
-  client = accept(socket_id, (struct sockaddr *)&client_addr, &n);
+  // The socket isn't non-blocking until it's watched, so this waits for
+  // the FrontDoor to hand over the first connection.
+  client = net_accept();
 
   if (client == -1) { return -1; }
 
-  fcntl(client, F_SETFL, O_NONBLOCK);
+  return 0;
+}
+
+int Network::net_listen(const char *path)
+{
+  struct sockaddr_un server_addr;
+
+  if (strlen(path) >= sizeof(server_addr.sun_path))
+  {
+    printf("Socket path %s is too long.\n", path);
+    return -1;
+  }
+
+  // Each message is one connection with the data read from it, so the
+  // boundaries between them have to be kept.
+  socket_id = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+  if (socket_id < 0)
+  {
+    printf("Can't open socket.\n");
+    return -1;
+  }
+
+  memset((char*)&server_addr, 0, sizeof(server_addr));
+  server_addr.sun_family = AF_UNIX;
+  strcpy(server_addr.sun_path, path);
+
+  // Left behind by a game that didn't exit cleanly.
+  unlink(path);
+
+  if (bind(socket_id, (const sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+  {
+    printf("Server can't bind to %s.\n", path);
+    return -1;
+  }
+
+  strcpy(socket_path, path);
+
+  if (listen(socket_id, SOMAXCONN) != 0)
+  {
+    printf("Listen failed.\n");
+    return -1;
+  }
+
+  handoff_mode = HANDOFF_LISTEN;
+
+  return 0;
+}
+
+int Network::net_open_control(int fd)
+{
+  socket_id = fd;
+  handoff_mode = HANDOFF_CONTROL;
+
+  // Like net_open(), this waits for the first connection.
+  client = net_accept();
+
+  if (client == -1) { return -1; }
 
   return 0;
 }
@@ -88,9 +217,91 @@ void Network::net_close()
     close(socket_id);
     socket_id = -1;
   }
+
+  if (socket_path[0] != 0)
+  {
+    unlink(socket_path);
+    socket_path[0] = 0;
+  }
+
+  handoff_mode = HANDOFF_NONE;
+}
+
+int Network::net_accept()
+{
+  struct sockaddr_in client_addr;
+  socklen_t n = sizeof(client_addr);
+
+  // Each connection from the FrontDoor is only open long enough to pass
+  // one browser connection over it. A ProcessPool sends them all on the
+  // control socket.
+  while (handoff_mode != HANDOFF_NONE)
+  {
+    int fd;
+
+    if (handoff_mode == HANDOFF_LISTEN)
+    {
+      struct timeval tv;
+      const int door = accept4(socket_id, NULL, NULL, SOCK_CLOEXEC);
+
+      if (door == -1) { return -1; }
+
+      // The FrontDoor sends as soon as it connects, so this doesn't
+      // really wait, but a FrontDoor that's stuck can't hold up the
+      // network thread for long either.
+      tv.tv_sec = 1;
+      tv.tv_usec = 0;
+
+      setsockopt(door, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+      fd = receive_handoff(door);
+
+      close(door);
+
+      if (fd == -1) { continue; }
+    }
+      else
+    {
+      fd = receive_handoff(socket_id);
+
+      if (fd == -1) { return -1; }
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    set_send_buffer(fd);
+
+    return fd;
+  }
+
+  handoff_length = 0;
+
+  // Returns -1 when there are no more connections waiting. The
+  // listening socket is edge triggered, so call until then.
+  int fd = accept4(
+    socket_id,
+    (struct sockaddr *)&client_addr,
+    &n,
+    SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd == -1) { return -1; }
+
+  set_send_buffer(fd);
+
+  return fd;
 }
 
-int Network::net_send(const uint8_t *buffer, int length)
+void Network::net_disconnect(int fd)
+{
+  if (fd == client) { client = -1; }
+
+  // Closing it would remove it from epoll too, but only if it's the
+  // last descriptor for the socket.
+  if (epoll_fd != -1) { epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL); }
+
+  close(fd);
+}
+
+int Network::net_send(int fd, const uint8_t *buffer, int length)
 {
   struct timeval tv;
   fd_set writeset;
@@ -100,12 +311,12 @@ int Network::net_send(const uint8_t *buffer, int length)
   while (bytes_sent < length)
   {
     FD_ZERO(&writeset);
-    FD_SET(client, &writeset);
+    FD_SET(fd, &writeset);
 
     tv.tv_sec = 10;
     tv.tv_usec = 0;
 
-    int n = select(client + 1, NULL, &writeset, NULL, &tv);
+    int n = select(fd + 1, NULL, &writeset, NULL, &tv);
 
     if (n == -1)
     {
@@ -117,7 +328,9 @@ int Network::net_send(const uint8_t *buffer, int length)
 
     if (n == 0) { return -3; }
 
-    n = send(client, buffer + bytes_sent, length - bytes_sent, 0);
+    // Without MSG_NOSIGNAL a browser closing the connection would
+    // kill the program with SIGPIPE.
+    n = send(fd, buffer + bytes_sent, length - bytes_sent, MSG_NOSIGNAL);
     if (n < 0) { return -4; }
 
     bytes_sent += n;
@@ -126,7 +339,11 @@ int Network::net_send(const uint8_t *buffer, int length)
   return bytes_sent;
 }
 
-int Network::net_recv(uint8_t *buffer, int length, bool wait_for_full_buffer)
+int Network::net_recv(
+  int fd,
+  uint8_t *buffer,
+  int length,
+  bool wait_for_full_buffer)
 {
   struct timeval tv;
   fd_set readset;
@@ -137,12 +354,12 @@ int Network::net_recv(uint8_t *buffer, int length, bool wait_for_full_buffer)
   while (bytes_received < length)
   {
     FD_ZERO(&readset);
-    FD_SET(client, &readset);
+    FD_SET(fd, &readset);
 
     tv.tv_sec = 10;
     tv.tv_usec = 0;
 
-    int n = select(client + 1, &readset, NULL, NULL, &tv);
+    int n = select(fd + 1, &readset, NULL, NULL, &tv);
 
     if (n == -1)
     {
@@ -154,9 +371,9 @@ int Network::net_recv(uint8_t *buffer, int length, bool wait_for_full_buffer)
 
     if (n == 0) { return -3; }
 
-    if (!FD_ISSET(client, &readset)) { continue; }
+    if (!FD_ISSET(fd, &readset)) { continue; }
 
-    n = recv(client, buffer + bytes_received, length - bytes_received, 0);
+    n = recv(fd, buffer + bytes_received, length - bytes_received, 0);
     if (n < 0) { return -4; }
 
     bytes_received += n;
@@ -174,28 +391,299 @@ int Network::net_recv(uint8_t *buffer, int length, bool wait_for_full_buffer)
   return bytes_received;
 }
 
-bool Network::net_has_data()
+int Network::net_watch(int fd)
 {
-  struct timeval tv;
-  fd_set readset;
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.fd = fd;
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+  {
+    perror("Problem with epoll_ctl in net_watch");
+    return -1;
+  }
+
+  return 0;
+}
+
+void Network::net_unwatch(int fd)
+{
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int Network::net_wait(struct epoll_event *events, int max_events, int ms)
+{
+  int count = epoll_wait(epoll_fd, events, max_events, ms);
+
+  if (count == -1)
+  {
+    if (errno == EINTR) { return 0; }
+
+    perror("Problem with epoll_wait in net_wait");
+    return -1;
+  }
+
+  // The wake up pipe isn't returned, it only makes this return early.
+  for (int n = 0; n < count; n++)
+  {
+    if (events[n].data.fd != wake_pipe[0]) { continue; }
+
+    uint8_t buffer[64];
+
+    while (read(wake_pipe[0], buffer, sizeof(buffer)) > 0) { }
+
+    events[n] = events[--count];
+    break;
+  }
+
+  return count;
+}
 
-  FD_ZERO(&readset);
-  FD_SET(client, &readset);
+int Network::net_recv_some(int fd, uint8_t *buffer, int length)
+{
+  int n;
+
+  do
+  {
+    n = recv(fd, buffer, length, MSG_DONTWAIT);
+  } while (n < 0 && errno == EINTR);
+
+  // The other side closed the connection.
+  if (n == 0) { return -1; }
+
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return 0; }
+
+    return -1;
+  }
+
+  return n;
+}
+
+int Network::net_send_some(int fd, const uint8_t *buffer, int length)
+{
+  int n;
+
+  do
+  {
+    n = send(fd, buffer, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+  } while (n < 0 && errno == EINTR);
 
-  tv.tv_sec = 0;
-  tv.tv_usec = 0;
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) { return 0; }
 
-  int n = select(client + 1, &readset, NULL, NULL, &tv);
+    return -1;
+  }
 
-  if (n == -1)
+  return n;
+}
+
+int Network::net_flush(int fd, OutputQueue &output)
+{
+  while (!output.is_empty())
   {
-    if (errno == EINTR) { return false; }
+    int n = net_send_some(fd, output.get_data(), output.get_data_length());
 
-    perror("Problem with select in Network");
-    net_close();
-    return false;
+    if (n < 0) { return -1; }
+
+    // The socket is full. epoll says when it can take more.
+    if (n == 0) { break; }
+
+    output.sent(n);
   }
 
-  return FD_ISSET(client, &readset);
+  return 0;
+}
+
+int Network::net_handoff(
+  const char *path,
+  int fd,
+  const uint8_t *data,
+  int length)
+{
+  // Returns -1 if there's nothing listening on path or -2 if it isn't
+  // taking connections right now. The caller still has to close fd.
+  struct sockaddr_un addr;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) { return -1; }
+
+  const int door =
+    socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (door < 0) { return -1; }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  // Connecting to a Unix socket doesn't wait for the other side to
+  // accept, it only fails with EAGAIN if its backlog is full.
+  if (connect(door, (const sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    const int error = errno;
+
+    close(door);
+
+    return error == EAGAIN ? -2 : -1;
+  }
+
+  // It's still delivered after the close, the same as data on a TCP
+  // socket.
+  const int result = net_handoff(door, fd, data, length);
+
+  close(door);
+
+  return result;
+}
+
+int Network::net_handoff(
+  int door,
+  int fd,
+  const uint8_t *data,
+  int length)
+{
+  // Passes fd and the data read from it over door, which is connected
+  // to the process that takes it. Returns -1 on error or -2 if door is
+  // full.
+  struct msghdr message;
+  struct iovec iov;
+  union
+  {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  if (length < 1 || length > MAX_HANDOFF_DATA) { return -1; }
+
+  iov.iov_base = (void *)data;
+  iov.iov_len = length;
+
+  memset(&control, 0, sizeof(control));
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+  int n;
+
+  do
+  {
+    n = sendmsg(door, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+  } while (n < 0 && errno == EINTR);
+
+  if (n == length) { return 0; }
+
+  return n < 0 && errno == EAGAIN ? -2 : -1;
+}
+
+int Network::receive_handoff(int door)
+{
+  // Returns the connection passed over door, or -1 if it didn't come.
+  struct msghdr message;
+  struct iovec iov;
+
+  // Room for more than the one descriptor that should come, so any
+  // extras end up here where they can be closed.
+  union
+  {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+  } control;
+  int fd = -1;
+  int count = 0;
+  int n;
+
+  iov.iov_base = handoff_data;
+  iov.iov_len = sizeof(handoff_data);
+
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  do
+  {
+    n = recvmsg(door, &message, MSG_CMSG_CLOEXEC);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0) { return -1; }
+
+  // Every descriptor that came is now open in this process, so any that
+  // aren't used have to be closed.
+  for (struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+       header != NULL;
+       header = CMSG_NXTHDR(&message, header))
+  {
+    if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+    {
+      continue;
+    }
+
+    const int length = header->cmsg_len - CMSG_LEN(0);
+    const uint8_t *data = CMSG_DATA(header);
+
+    for (int i = 0; i + (int)sizeof(int) <= length; i += sizeof(int))
+    {
+      int received;
+
+      memcpy(&received, data + i, sizeof(int));
+
+      if (count++ == 0)
+      {
+        fd = received;
+      }
+        else
+      {
+        close(received);
+      }
+    }
+  }
+
+  // It has to be exactly one connection and the whole request, or it
+  // can't be used.
+  if (count != 1 || n == 0 ||
+      (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0)
+  {
+    if (fd != -1) { close(fd); }
+    return -1;
+  }
+
+  handoff_length = n;
+
+  return fd;
+}
+
+void Network::set_send_buffer(int fd)
+{
+  // Left alone, Linux lets the send buffer grow to megabytes, which is
+  // seconds of video. Keeping it small means what's waiting stays in the
+  // OutputQueue where old frames can still be dropped.
+  int size = SEND_BUFFER_SIZE;
+
+  setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
+void Network::net_wake()
+{
+  const uint8_t value = 1;
+
+  if (wake_pipe[1] == -1) { return; }
+
+  // If the pipe is full there's already a wake up waiting.
+  if (write(wake_pipe[1], &value, 1) < 0) { return; }
 }
 
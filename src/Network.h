@@ -8,7 +8,31 @@
  * Copyright 2021 by Michael Kohn
  *
  * Network is used to abstract out all the socket() functionality and
- * is currently used by TelevisionHttp and TelevisionVNC.
+ * is currently used by TelevisionHttp, TelevisionVNC, SessionServer and
+ * FrontDoor.
+ *
+ * net_open() waits for the first connection. net_listen() only opens
+ * the port, for a server that takes every connection from net_accept().
+ *
+ * Given a path instead of a port, they open a Unix socket that a
+ * FrontDoor hands connections to. It has already accepted them and
+ * read the start of the first request to see where they go. The
+ * connection comes with that data (SCM_RIGHTS), and net_accept()
+ * returns the connection with the data in handoff_data. net_handoff()
+ * is the FrontDoor's side of this. net_open_control() does the same
+ * with a socket already connected to a ProcessPool, which hands over
+ * every connection for its game on that one socket.
+ * net_send() and net_recv() block (for up to 10 seconds) and are only for
+ * setting up a connection before anything else is going on, like the
+ * VNC handshake.
+ *
+ * After that a network thread does everything from an epoll loop. The
+ * sockets are non-blocking and edge triggered: net_watch() adds one,
+ * net_wait() returns the ones that changed, and each one has to be read
+ * with net_recv_some() until it returns 0 (nothing left) and written
+ * with net_flush() until its OutputQueue is empty or the socket is full.
+ * net_wake() from another thread makes net_wait() return right away,
+ * for example when there is a new frame queued.
  *
  */
 
@@ -16,6 +40,9 @@
 #define NETWORK_H
 
 #include <stdint.h>
+#include <sys/epoll.h>
+
+#include "OutputQueue.h"
 
 class Network
 {
@@ -24,15 +51,69 @@ protected:
   ~Network();
 
   int net_open(int port);
+  int net_listen(int port);
+  int net_open(const char *path);
+  int net_listen(const char *path);
+  int net_open_control(int fd);
   void net_close();
-  int net_send(const uint8_t *buffer, int len);
-  int net_recv(uint8_t *buffer, int len, bool wait_for_full_buffer = true);
-  bool net_has_data();
+  int net_accept();
+  void net_disconnect(int fd);
+  int net_send(int fd, const uint8_t *buffer, int len);
+  int net_recv(int fd, uint8_t *buffer, int len, bool wait_for_full_buffer);
   bool net_is_connected() { return socket_id != -1; }
 
+  int net_watch(int fd);
+  void net_unwatch(int fd);
+  int net_wait(struct epoll_event *events, int max_events, int ms);
+  int net_recv_some(int fd, uint8_t *buffer, int length);
+  int net_send_some(int fd, const uint8_t *buffer, int length);
+  int net_flush(int fd, OutputQueue &output);
+  int net_handoff(const char *path, int fd, const uint8_t *data, int length);
+  int net_handoff(int door, int fd, const uint8_t *data, int length);
+  void net_wake();
+
+  int net_send(const uint8_t *buffer, int len)
+  {
+    return net_send(client, buffer, len);
+  }
+
+  int net_recv(uint8_t *buffer, int len, bool wait_for_full_buffer = true)
+  {
+    return net_recv(client, buffer, len, wait_for_full_buffer);
+  }
+
+  static const int SEND_BUFFER_SIZE = 64 * 1024;
+  static const int MAX_HANDOFF_DATA = 1024;
+
   int socket_id;
   int client;
   int port;
+  int epoll_fd;
+  int wake_pipe[2];
+
+  // What the FrontDoor read from the last connection net_accept()
+  // returned. It's always empty for a port.
+  uint8_t handoff_data[MAX_HANDOFF_DATA];
+  int handoff_length;
+
+private:
+  int receive_handoff(int door);
+  void set_send_buffer(int fd);
+
+  // A handoff with more descriptors than this loses the rest to the
+  // kernel, which closes them.
+  static const int MAX_HANDOFF_FDS = 8;
+
+  // Where net_accept() gets its connections from.
+  enum
+  {
+    HANDOFF_NONE,
+    HANDOFF_LISTEN,
+    HANDOFF_CONTROL,
+  };
+
+  int handoff_mode;
+  char socket_path[108];
 };
 
 #endif
@@ -0,0 +1,106 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "OutputQueue.h"
+
+OutputQueue::OutputQueue() :
+  offset{0},
+  length{0},
+  frames{0}
+{
+}
+
+OutputQueue::~OutputQueue()
+{
+}
+
+OutputQueue::Buffer OutputQueue::make_buffer(
+  const uint8_t *header,
+  int header_length,
+  const uint8_t *data,
+  int length)
+{
+  std::string *buffer = new std::string();
+
+  buffer->reserve(header_length + length);
+
+  if (header_length != 0)
+  {
+    buffer->append((const char *)header, header_length);
+  }
+
+  buffer->append((const char *)data, length);
+
+  return Buffer(buffer);
+}
+
+void OutputQueue::push(const Buffer &buffer, bool frame)
+{
+  if (buffer == nullptr || buffer->empty()) { return; }
+
+  packets.push_back(Packet{buffer, frame});
+
+  length += buffer->size();
+  if (frame) { frames++; }
+}
+
+int OutputQueue::drop_frames()
+{
+  std::deque<Packet>::iterator iter = packets.begin();
+  int count = 0;
+
+  // Part of the first one is already sent.
+  if (offset != 0) { iter++; }
+
+  while (iter != packets.end())
+  {
+    if (!iter->frame)
+    {
+      iter++;
+      continue;
+    }
+
+    length -= iter->data->size();
+    frames--;
+    count++;
+
+    iter = packets.erase(iter);
+  }
+
+  return count;
+}
+
+void OutputQueue::clear()
+{
+  packets.clear();
+
+  offset = 0;
+  length = 0;
+  frames = 0;
+}
+
+void OutputQueue::sent(int count)
+{
+  offset += count;
+  length -= count;
+
+  if (offset < (int)packets.front().data->size()) { return; }
+
+  if (packets.front().frame) { frames--; }
+
+  packets.pop_front();
+  offset = 0;
+}
+
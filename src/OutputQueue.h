@@ -0,0 +1,105 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * OutputQueue holds what's waiting to be sent on one connection as a
+ * list of whole packets, so Network::net_flush() can send as much as the
+ * socket takes and pick up where it left off later.
+ *
+ * Packets pushed as frames can be thrown away with drop_frames() if the
+ * connection falls behind. A frame that has started going out is never
+ * dropped, since the other side would get half of it. Frames are usually
+ * only what changed since the one before, so drop_frames() drops all of
+ * them and the caller sends a whole frame next.
+ *
+ * Packets are reference counted Buffers, so a frame that's compressed
+ * once can be queued on every connection watching without a copy for
+ * each one.
+ *
+ */
+
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+
+class OutputQueue
+{
+public:
+  OutputQueue();
+  ~OutputQueue();
+
+  typedef std::shared_ptr<const std::string> Buffer;
+
+  static Buffer make_buffer(const uint8_t *data, int length)
+  {
+    return make_buffer(nullptr, 0, data, length);
+  }
+
+  static Buffer make_buffer(
+    const uint8_t *header,
+    int header_length,
+    const uint8_t *data,
+    int length);
+
+  void push(const Buffer &buffer, bool frame = false);
+
+  void push(const uint8_t *data, int length, bool frame = false)
+  {
+    push(make_buffer(data, length), frame);
+  }
+
+  void push(
+    const uint8_t *header,
+    int header_length,
+    const uint8_t *data,
+    int length,
+    bool frame)
+  {
+    push(make_buffer(header, header_length, data, length), frame);
+  }
+
+  int drop_frames();
+  void clear();
+
+  bool is_empty() { return packets.empty(); }
+  int get_length() { return length; }
+  int get_frames() { return frames; }
+
+  // The part of the first packet that hasn't been sent yet.
+  const uint8_t *get_data()
+  {
+    return (const uint8_t *)packets.front().data->data() + offset;
+  }
+
+  int get_data_length() { return packets.front().data->size() - offset; }
+
+  void sent(int count);
+
+private:
+  struct Packet
+  {
+    Buffer data;
+    bool frame;
+  };
+
+  std::deque<Packet> packets;
+
+  // Bytes of the first packet already sent.
+  int offset;
+
+  // Bytes not sent yet and the number of frames.
+  int length;
+  int frames;
+};
+
+#endif
+
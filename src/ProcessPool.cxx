@@ -0,0 +1,267 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "ProcessPool.h"
+
+ProcessPool::ProcessPool() :
+  ready_count{0},
+  next_id{1}
+{
+  memset(program, 0, sizeof(program));
+
+  for (int n = 0; n < MAX_PROCESSES; n++)
+  {
+    processes[n].pid = -1;
+    processes[n].control = -1;
+    processes[n].id = 0;
+  }
+}
+
+ProcessPool::~ProcessPool()
+{
+  // Games already being played keep going. The ones still waiting see
+  // the control socket close and exit.
+  for (int n = 0; n < MAX_PROCESSES; n++)
+  {
+    if (processes[n].control != -1) { close(processes[n].control); }
+  }
+}
+
+int ProcessPool::init(const char *rom_path, int port, int ready_count)
+{
+  if (ready_count < 1) { ready_count = 1; }
+  if (ready_count > MAX_PROCESSES) { ready_count = MAX_PROCESSES; }
+
+  this->ready_count = ready_count;
+
+  if (readlink("/proc/self/exe", program, sizeof(program) - 1) < 0)
+  {
+    perror("Can't find the cloudtari program");
+    return -1;
+  }
+
+  if (FrontDoor::init(rom_path, port) != 0) { return -1; }
+
+  fill();
+
+  printf("Keeping %d games ready.\n", ready_count);
+
+  return 0;
+}
+
+int ProcessPool::wait_for_game(int control, char *rom, int length, int *id)
+{
+  // Called in the waiting process. Returns -1 if the pool went away.
+  char message[256];
+  char format[32];
+  int n;
+
+  do
+  {
+    n = recv(control, message, sizeof(message) - 1, 0);
+  } while (n < 0 && errno == EINTR);
+
+  if (n <= 0) { return -1; }
+
+  message[n] = 0;
+
+  snprintf(format, sizeof(format), "%%d %%%ds", length - 1);
+
+  if (sscanf(message, format, id, rom) != 2) { return -1; }
+
+  return 0;
+}
+
+int ProcessPool::route(Pending &pending, const char *path)
+{
+  return route_game(pending, path);
+}
+
+int ProcessPool::join_game(int id, Pending &pending)
+{
+  Process *process = find_game(id);
+
+  const int result = net_handoff(
+    process->control,
+    pending.fd,
+    pending.input,
+    pending.input_length);
+
+  if (result < 0)
+  {
+    send_response(pending.fd, "503 Service Unavailable", nullptr);
+    return -1;
+  }
+
+  // The game has its own copy of the connection now.
+  close(pending.fd);
+
+  return 0;
+}
+
+void ProcessPool::check_pending()
+{
+  pid_t pid;
+  int status;
+
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+  {
+    for (int n = 0; n < MAX_PROCESSES; n++)
+    {
+      Process &process = processes[n];
+
+      if (process.pid != pid) { continue; }
+
+      if (process.id != 0) { printf("Game %d finished.\n", process.id); }
+
+      close(process.control);
+
+      process.pid = -1;
+      process.control = -1;
+      process.id = 0;
+      break;
+    }
+  }
+
+  fill();
+
+  FrontDoor::check_pending();
+}
+
+int ProcessPool::start_game(const char *name)
+{
+  // Returns the id of the game, -1 if there's no such ROM or -2 if
+  // there's no process ready for it.
+  char filename[256];
+  char message[160];
+  Process *process = nullptr;
+
+  snprintf(filename, sizeof(filename), "%s/%s", directory, name);
+
+  if (access(filename, R_OK) != 0) { return -1; }
+
+  for (int n = 0; n < MAX_PROCESSES; n++)
+  {
+    if (processes[n].pid != -1 && processes[n].id == 0)
+    {
+      process = &processes[n];
+      break;
+    }
+  }
+
+  if (process == nullptr)
+  {
+    printf("No games ready.\n");
+    return -2;
+  }
+
+  const int length =
+    snprintf(message, sizeof(message), "%d %s", next_id, name);
+
+  if (net_send_some(process->control, (uint8_t *)message, length) != length)
+  {
+    return -2;
+  }
+
+  process->id = next_id;
+
+  printf("Game %d started: %s (pid %d)\n", next_id, name, process->pid);
+
+  // Get the next one ready now instead of when the next player shows up.
+  fill();
+
+  return next_id++;
+}
+
+int ProcessPool::start_process(Process &process)
+{
+  int sockets[2];
+  char control[16];
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0)
+  {
+    perror("Can't create control socket");
+    return -1;
+  }
+
+  const pid_t pid = fork();
+
+  if (pid == -1)
+  {
+    perror("Can't fork");
+    close(sockets[0]);
+    close(sockets[1]);
+    return -1;
+  }
+
+  if (pid == 0)
+  {
+    // Everything the pool opens is closed by execl(), so the game keeps
+    // only stdio and its end of the control socket. Otherwise it would
+    // hold the pool's port and other games' connections open.
+    if (fcntl(sockets[1], F_SETFD, 0) != 0) { _exit(1); }
+
+    snprintf(control, sizeof(control), "%d", sockets[1]);
+
+    execl(program, program, directory, "pooled", control, NULL);
+
+    perror("Can't start game process");
+    _exit(1);
+  }
+
+  close(sockets[1]);
+  fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+
+  process.pid = pid;
+  process.control = sockets[0];
+  process.id = 0;
+
+  return 0;
+}
+
+void ProcessPool::fill()
+{
+  int ready = 0;
+
+  for (int n = 0; n < MAX_PROCESSES; n++)
+  {
+    if (processes[n].pid != -1 && processes[n].id == 0) { ready++; }
+  }
+
+  for (int n = 0; n < MAX_PROCESSES && ready < ready_count; n++)
+  {
+    if (processes[n].pid != -1) { continue; }
+    if (start_process(processes[n]) != 0) { break; }
+
+    ready++;
+  }
+}
+
+ProcessPool::Process *ProcessPool::find_game(int id)
+{
+  for (int n = 0; n < MAX_PROCESSES; n++)
+  {
+    if (processes[n].pid == -1 || processes[n].id == 0) { continue; }
+    if (processes[n].id == id) { return &processes[n]; }
+  }
+
+  return nullptr;
+}
+
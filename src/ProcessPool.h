@@ -0,0 +1,73 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * ProcessPool is a FrontDoor that starts its own games, each one in its
+ * own process, and keeps a few processes started ahead of time so a
+ * new game doesn't wait for one.
+ *
+ * The waiting processes are "cloudtari <rom directory> pooled <fd>",
+ * where fd is a control socket back to the pool. They get everything
+ * ready that doesn't need the ROM and wait in wait_for_game(). GET
+ * /play?game.bin sends one of them "id game.bin" on its control socket
+ * and redirects the browser to /id/. The process loads the ROM and from
+ * then on gets every connection for /id/ on the control socket, the
+ * same as from a FrontDoor. When the game ends, the process exits and
+ * another one is started to take its place.
+ *
+ */
+
+#ifndef PROCESS_POOL_H
+#define PROCESS_POOL_H
+
+#include <sys/types.h>
+
+#include "FrontDoor.h"
+
+class ProcessPool : public FrontDoor
+{
+public:
+  ProcessPool();
+  virtual ~ProcessPool();
+
+  int init(const char *rom_path, int port, int ready_count);
+
+  static int wait_for_game(int control, char *rom, int length, int *id);
+
+protected:
+  virtual int route(Pending &pending, const char *path);
+  virtual void check_pending();
+  virtual int start_game(const char *name);
+  virtual bool has_game(int id) { return find_game(id) != nullptr; }
+  virtual int join_game(int id, Pending &pending);
+
+private:
+  struct Process
+  {
+    pid_t pid;
+    int control;
+
+    // 0 until it's given a game.
+    int id;
+  };
+
+  int start_process(Process &process);
+  void fill();
+  Process *find_game(int id);
+
+  static const int MAX_PROCESSES = 64;
+
+  // This program, to start the waiting processes with.
+  char program[256];
+  int ready_count;
+  int next_id;
+  Process processes[MAX_PROCESSES];
+};
+
+#endif
+
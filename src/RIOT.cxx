@@ -36,6 +36,42 @@ void RIOT::reset()
 
   prescale = TIM1T;
   prescale_shift = TIM1T_SHIFT;
+  interrupt_timer = 255;
+  cycle = 0;
+  timer_cycle = 0;
+}
+
+void RIOT::save_state(State &state)
+{
+  state.cycle = cycle;
+  state.timer_cycle = timer_cycle;
+  state.prescale = prescale;
+  state.prescale_shift = prescale_shift;
+  state.interrupt_timer = interrupt_timer;
+  memcpy(state.riot, riot, sizeof(state.riot));
+  memcpy(state.ram, ram + 128, sizeof(state.ram));
+}
+
+void RIOT::load_state(const State &state)
+{
+  cycle = state.cycle;
+  timer_cycle = state.timer_cycle;
+  prescale = state.prescale;
+  prescale_shift = state.prescale_shift;
+  interrupt_timer = state.interrupt_timer;
+  memcpy(riot, state.riot, sizeof(riot));
+  memcpy(ram + 128, state.ram, sizeof(state.ram));
+}
+
+bool RIOT::check_state(const State &state)
+{
+  // The timer shifts by prescale_shift, so only the four real settings
+  // are allowed.
+  return
+    (state.prescale_shift == TIM1T_SHIFT && state.prescale == TIM1T) ||
+    (state.prescale_shift == TIM8T_SHIFT && state.prescale == TIM8T) ||
+    (state.prescale_shift == TIM64T_SHIFT && state.prescale == TIM64T) ||
+    (state.prescale_shift == T1024T_SHIFT && state.prescale == T1024T);
 }
 
 uint8_t RIOT::read_memory(int address)
@@ -45,12 +81,10 @@ uint8_t RIOT::read_memory(int address)
     return ram[address];
   }
 
-#if 0
-  if (address == INTIM)
+  if ((address & 0x07) == (INTIM & 0x07))
   {
-    return interrupt_timer;
+    return read_timer();
   }
-#endif
 
   return riot[address & 0x07];
 }
@@ -95,7 +129,7 @@ void RIOT::write_memory(int address, uint8_t value)
 
     //interrupt_timer = ((value + 1) * prescale) - 1;
     interrupt_timer = value * prescale;
-    riot[4] = interrupt_timer >> prescale_shift;
+    timer_cycle = cycle;
 
     return;
   }
@@ -104,20 +138,13 @@ void RIOT::write_memory(int address, uint8_t value)
   return;
 }
 
-void RIOT::clock(int ticks)
+uint8_t RIOT::read_timer()
 {
-  while (ticks > 0)
-  {
-    interrupt_timer--;
+  // The timer counts down once every prescale CPU cycles. Once it passes
+  // 0 it counts down once per cycle until it's written again.
+  const int64_t timer = interrupt_timer - (int64_t)(cycle - timer_cycle);
 
-    if (interrupt_timer == 0)
-    {
-      prescale_shift = 0;
-    }
+  if (timer > 0) { return timer >> prescale_shift; }
 
-    ticks--;
-  }
-
-  riot[4] = (interrupt_timer >> prescale_shift) & 0xff;
+  return timer & 0xff;
 }
-
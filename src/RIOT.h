@@ -8,7 +8,9 @@
  * Copyright 2021 by Michael Kohn
  *
  * The RIOT chip (MOS 6532) has 128 bytes of RAM (address 0x80 to 0xff),
- * I/O for the select / reset etc buttons, and a countdown timer.
+ * I/O for the select / reset etc buttons, and a countdown timer. The timer
+ * isn't clocked, INTIM is computed from the number of CPU cycles since
+ * the timer was written.
  *
  */
 
@@ -20,13 +22,31 @@
 class RIOT
 {
 public:
+  // Everything that changes as a game runs, for SnapshotCache. Only the
+  // upper half of ram is used (0x80 to 0xff).
+  struct State
+  {
+    uint64_t cycle;
+    uint64_t timer_cycle;
+    int32_t prescale;
+    int32_t prescale_shift;
+    int32_t interrupt_timer;
+    uint8_t riot[8];
+    uint8_t ram[128];
+  };
+
   RIOT();
   ~RIOT();
 
   void reset();
+  void save_state(State &state);
+  void load_state(const State &state);
+  bool check_state(const State &state);
   uint8_t read_memory(int address);
   void write_memory(int address, uint8_t value);
-  void clock(int ticks);
+  void sync(uint64_t cycle) { this->cycle = cycle; }
+  void reset_cycle() { cycle = 0; timer_cycle = 0; }
+  uint8_t *get_ram() { return ram; }
   void set_switch_reset()    { riot[SWCHB & 0x7] &= 0xfe; }
   void set_switch_select()   { riot[SWCHB & 0x7] &= 0xfd; }
   void clear_switch_reset()  { riot[SWCHB & 0x7] |= 0x01; }
@@ -64,11 +84,15 @@ private:
   const int SWACNT = 0x281;
   const int SWCHB = 0x282;
   //const int SWBCNT = 0x281;
-  //const int INTIM = 0x284;
+  const int INTIM = 0x284;
+
+  uint8_t read_timer();
 
   int prescale;
   int prescale_shift;
-  int interrupt_timer = 255;
+  int interrupt_timer;
+  uint64_t cycle;
+  uint64_t timer_cycle;
 
   uint8_t riot[8];
   uint8_t ram[256];
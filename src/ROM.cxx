@@ -17,9 +17,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "FrameHash.h"
 #include "ROM.h"
 
-ROM::ROM() : size(0)
+ROM::ROM() : hash(0), size(0), bank(0)
 {
   memset(memory, 0, sizeof(memory));
 }
@@ -71,6 +72,10 @@ int ROM::load(const char *filename)
     memcpy(memory, full, 4096);
   }
 
+  // Tells which game a SaveState is from.
+  hash = FrameHash::compute(full, size);
+  bank = 0;
+
   return 0;
 }
 
@@ -79,6 +84,7 @@ bool ROM::set_bank(int value)
   if (size < 8192) { return false; }
 
   memcpy(memory, full + (value * 4096), 4096);
+  bank = value;
 
   return true;
 }
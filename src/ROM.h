@@ -26,6 +26,10 @@ public:
 
   int load(const char *filename);
   bool set_bank(int value);
+  int get_bank() { return bank; }
+  uint8_t *get_memory() { return memory; }
+  int get_bank_count() { return size == 8192 ? 2 : 1; }
+  uint64_t get_hash() { return hash; }
 
   uint8_t read_int8(int address)
   {
@@ -40,7 +44,9 @@ public:
 private:
   uint8_t memory[4096];
   uint8_t full[8192];
+  uint64_t hash;
   int size;
+  int bank;
 };
 
 #endif
@@ -0,0 +1,166 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "RleCompressor.h"
+
+RleCompressor::RleCompressor() :
+  width{0},
+  height{0},
+  data{nullptr},
+  data_length{0},
+  length{0}
+{
+}
+
+RleCompressor::~RleCompressor()
+{
+  free(data);
+}
+
+int RleCompressor::palette(uint32_t *color_table)
+{
+  resize_buffer(1 + 128 * 3);
+
+  data[0] = 'P';
+
+  for (int n = 0; n < 128; n++)
+  {
+    data[1 + (n * 3) + 0] = (color_table[n] >> 16) & 0xff;
+    data[1 + (n * 3) + 1] = (color_table[n] >> 8) & 0xff;
+    data[1 + (n * 3) + 2] =  color_table[n] & 0xff;
+  }
+
+  length = 1 + 128 * 3;
+
+  return 0;
+}
+
+int RleCompressor::compress(uint8_t *image, uint8_t *previous)
+{
+  // Worst case is every pixel a different color from the one next to it.
+  resize_buffer(1 + width * height * 2);
+
+  uint8_t *output = data;
+  int skip = 0;
+
+  *output++ = 'F';
+
+  for (int y = 0; y < height; y++)
+  {
+    const uint8_t *row = image + (y * width);
+    const uint8_t *last = nullptr;
+
+    if (previous != nullptr) { last = previous + (y * width); }
+
+    if (last != nullptr && memcmp(row, last, width) == 0)
+    {
+      skip += width;
+      continue;
+    }
+
+    int x = 0;
+
+    while (x < width)
+    {
+      if (last != nullptr && row[x] == last[x])
+      {
+        uint64_t a, b;
+
+        // Most of a changed row is usually still the same as before.
+        while (x + 8 <= width)
+        {
+          memcpy(&a, row + x, 8);
+          memcpy(&b, last + x, 8);
+          if (a != b) { break; }
+          x += 8;
+          skip += 8;
+        }
+
+        while (x < width && row[x] == last[x])
+        {
+          x++;
+          skip++;
+        }
+
+        continue;
+      }
+
+      // The run can keep going over pixels that didn't change since it
+      // costs nothing more than skipping them.
+      const uint8_t color = row[x];
+      const uint64_t colors = color * 0x0101010101010101ULL;
+      int count = 1;
+      int end = width - x;
+
+      if (end > MAX_RUN) { end = MAX_RUN; }
+
+      while (count + 8 <= end)
+      {
+        uint64_t a;
+
+        memcpy(&a, row + x + count, 8);
+        if (a != colors) { break; }
+        count += 8;
+      }
+
+      while (count < end && row[x + count] == color) { count++; }
+
+      output = write_skip(output, skip);
+      skip = 0;
+
+      *output++ = color;
+      *output++ = count - 1;
+
+      x += count;
+    }
+  }
+
+  // Pixels skipped at the end of the frame don't need to be sent.
+  length = output - data;
+
+  return 0;
+}
+
+uint8_t *RleCompressor::write_skip(uint8_t *output, int count)
+{
+  while (count >= width)
+  {
+    int rows = count / width;
+
+    if (rows > MAX_SKIP) { rows = MAX_SKIP; }
+
+    *output++ = 0xc0 | (rows - 1);
+    count -= rows * width;
+  }
+
+  while (count > 0)
+  {
+    const int pixels = count > MAX_SKIP ? MAX_SKIP : count;
+
+    *output++ = 0x80 | (pixels - 1);
+    count -= pixels;
+  }
+
+  return output;
+}
+
+void RleCompressor::resize_buffer(int needed)
+{
+  if (needed <= data_length) { return; }
+
+  data_length = needed;
+  data = (uint8_t *)realloc(data, data_length);
+}
+
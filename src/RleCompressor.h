@@ -0,0 +1,58 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * RleCompressor makes the frames TelevisionHttp sends on its WebSocket.
+ * Atari frames are big blocks of flat color, so instead of LZW each row
+ * is run length coded against the previous frame. The Javascript in the
+ * page that decodes them is only a few lines.
+ *
+ * A palette message is 'P' followed by 128 RGB colors. A frame message
+ * is 'F' followed by codes that move a pixel pointer through the frame
+ * starting at the top left:
+ *
+ *   0x00-0x7f n  Draw n + 1 pixels of that color.
+ *   0x80-0xbf    Skip (code & 0x3f) + 1 pixels that didn't change.
+ *   0xc0-0xff    Skip (code & 0x3f) + 1 rows that didn't change.
+ *
+ */
+
+#ifndef RLE_COMPRESSOR_H
+#define RLE_COMPRESSOR_H
+
+#include <stdint.h>
+
+class RleCompressor
+{
+public:
+  RleCompressor();
+  ~RleCompressor();
+
+  int palette(uint32_t *color_table);
+  int compress(uint8_t *image, uint8_t *previous);
+  void set_width(int value) { width = value; }
+  void set_height(int value) { height = value; }
+  uint8_t *get_data() { return data; }
+  int get_length() { return length; }
+
+private:
+  uint8_t *write_skip(uint8_t *output, int count);
+  void resize_buffer(int needed);
+
+  static const int MAX_RUN = 256;
+  static const int MAX_SKIP = 64;
+
+  int width;
+  int height;
+  uint8_t *data;
+  int data_length;
+  int length;
+};
+
+#endif
+
@@ -0,0 +1,74 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+#include "ROM.h"
+#include "SaveState.h"
+
+static_assert(
+  std::is_trivially_copyable<SaveState::Image>::value,
+  "SaveState::Image has to be plain data");
+
+const char SaveState::MAGIC[8] = { 'C', 'T', 'S', 'T', 'A', 'T', 'E', 0 };
+
+void SaveState::save(M6502 *m6502, MemoryBus *memory_bus, Image &image)
+{
+  memcpy(image.header.magic, MAGIC, sizeof(MAGIC));
+  image.header.version = VERSION;
+  image.header.size = sizeof(Image);
+  image.header.rom_hash = memory_bus->get_rom()->get_hash();
+
+  m6502->save_state(image.cpu);
+  memory_bus->save_state(image.bus);
+}
+
+int SaveState::restore(M6502 *m6502, MemoryBus *memory_bus, const Image &image)
+{
+  if (check(memory_bus, &image, sizeof(image)) == nullptr) { return -1; }
+
+  m6502->load_state(image.cpu);
+  memory_bus->load_state(image.bus);
+
+  return 0;
+}
+
+const SaveState::Image *SaveState::check(
+  MemoryBus *memory_bus,
+  const void *data,
+  int length)
+{
+  // Returns data as an Image if it is one for this ROM, or nullptr.
+  const Image *image = (const Image *)data;
+
+  if (length < (int)sizeof(Image)) { return nullptr; }
+
+  // Anything read in place has to be lined up like the Image would be.
+  if (((uintptr_t)data & (alignof(Image) - 1)) != 0) { return nullptr; }
+
+  if (memcmp(image->header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      image->header.version != VERSION ||
+      image->header.size != sizeof(Image) ||
+      image->header.rom_hash != memory_bus->get_rom()->get_hash())
+  {
+    return nullptr;
+  }
+
+  // The header can be right and the rest still be junk. Anything that
+  // would make the emulator read or write out of bounds is refused.
+  if (!memory_bus->check_state(image->bus)) { return nullptr; }
+
+  return image;
+}
+
@@ -0,0 +1,72 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * SaveState copies everything about a running game that can change
+ * (the CPU registers, the RIOT's RAM and timer, the TIA's registers and
+ * objects, and the ROM bank) in and out of an Image.
+ *
+ * An Image is plain data with no pointers, so it can be copied with
+ * memcpy, written to a file as is and used straight from a file that's
+ * mmap()ed. check() says if some bytes are an Image that can be
+ * restored into this game. The header has the ROM's hash, so an Image
+ * can't be restored into a different game, and a version that changes
+ * whenever one of the State structs does. Images are in the byte order
+ * of the machine that saved them.
+ *
+ * The TIA's frame and the CPU's decode cache aren't in the Image. The
+ * first is drawn again in the next frame and the second only depends
+ * on the ROM.
+ *
+ */
+
+#ifndef SAVE_STATE_H
+#define SAVE_STATE_H
+
+#include <stdint.h>
+
+#include "M6502.h"
+#include "MemoryBus.h"
+
+class SaveState
+{
+public:
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint64_t rom_hash;
+  };
+
+  struct Image
+  {
+    Header header;
+    M6502::State cpu;
+    MemoryBus::State bus;
+  };
+
+  static void save(M6502 *m6502, MemoryBus *memory_bus, Image &image);
+  static int restore(M6502 *m6502, MemoryBus *memory_bus, const Image &image);
+  static const Image *check(
+    MemoryBus *memory_bus,
+    const void *data,
+    int length);
+
+  // Changes when any of the State structs do, so old Images are refused.
+  static const uint32_t VERSION = 1;
+
+private:
+  SaveState() { }
+  ~SaveState() { }
+
+  static const char MAGIC[8];
+};
+
+#endif
+
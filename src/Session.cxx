@@ -0,0 +1,95 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Session.h"
+#include "SnapshotCache.h"
+
+Session::Session(int id) :
+  id{id},
+  booted{false}
+{
+  m6502 = new M6502();
+  memory_bus = new MemoryBus();
+  rom = new ROM();
+  television = new TelevisionHttp();
+}
+
+Session::~Session()
+{
+  delete television;
+  delete m6502;
+  delete rom;
+  delete memory_bus;
+}
+
+int Session::init(const char *filename)
+{
+  char path[32];
+
+  if (rom->load(filename) != 0) { return -1; }
+
+  memory_bus->init();
+  memory_bus->set_rom(rom);
+  m6502->set_memory_bus(memory_bus);
+  m6502->reset();
+
+  // The server sends it the requests for /id/ with the id taken off.
+  snprintf(path, sizeof(path), "/%d", id);
+
+  television->set_hosted();
+  television->set_base_path(path);
+
+  if (television->init() != 0) { return -1; }
+
+  memory_bus->get_tia()->set_television(television);
+
+  return 0;
+}
+
+bool Session::run_frame()
+{
+  // Returns false when the game is over.
+  TIA *tia = memory_bus->get_tia();
+
+  // Starting from the snapshot can mean running the game's whole boot,
+  // so it's done here on a worker instead of in init() on the server's
+  // network thread.
+  if (!booted)
+  {
+    SnapshotCache::boot(m6502, memory_bus);
+    booted = true;
+  }
+
+  const uint64_t end = m6502->get_total_cycles() + MAX_FRAME_CYCLES;
+
+  while (m6502->is_running() && m6502->get_total_cycles() < end)
+  {
+    m6502->step();
+
+    if (tia->need_check_events())
+    {
+      int event_code = television->handle_events();
+
+      if (event_code == Television::KEY_QUIT) { return false; }
+
+      memory_bus->handle_event(event_code);
+    }
+
+    if (television->finished_frame()) { return true; }
+  }
+
+  return m6502->is_running();
+}
+
@@ -0,0 +1,58 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * Session is one game running in a SessionServer, with its own ROM,
+ * M6502, MemoryBus (and with it the TIA and RIOT) and a hosted
+ * TelevisionHttp for the browsers playing and watching it.
+ *
+ * It has no thread of its own. The server's workers call run_frame()
+ * each time it's due, which runs the game until the TIA finishes a frame
+ * and the frame is encoded, then gives the worker back.
+ *
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+
+#include "M6502.h"
+#include "MemoryBus.h"
+#include "ROM.h"
+#include "TelevisionHttp.h"
+
+class Session
+{
+public:
+  Session(int id);
+  ~Session();
+
+  int init(const char *filename);
+  bool run_frame();
+  int get_id() { return id; }
+  TelevisionHttp *get_television() { return television; }
+
+private:
+  // If the game doesn't finish a frame in this many CPU cycles (4 frames)
+  // it gives up the worker anyway.
+  static const int MAX_FRAME_CYCLES = 76 * 262 * 4;
+
+  int id;
+
+  // The first run_frame() starts it from its snapshot (see SnapshotCache).
+  bool booted;
+
+  M6502 *m6502;
+  MemoryBus *memory_bus;
+  ROM *rom;
+  TelevisionHttp *television;
+};
+
+#endif
+
@@ -0,0 +1,276 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <chrono>
+
+#include "FramePacer.h"
+#include "SessionServer.h"
+
+SessionServer::SessionServer() :
+  next_id{1},
+  thread_count{0},
+  running{false}
+{
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    slots[n].session = nullptr;
+    slots[n].deadline = 0;
+    slots[n].busy = false;
+    slots[n].finished = false;
+  }
+}
+
+SessionServer::~SessionServer()
+{
+  running = false;
+  wake_workers.notify_all();
+
+  for (int n = 0; n < thread_count; n++)
+  {
+    workers[n].join();
+  }
+
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    if (slots[n].session == nullptr) { continue; }
+
+    net_unwatch(slots[n].session->get_television()->get_network_fd());
+    delete slots[n].session;
+  }
+}
+
+int SessionServer::init(const char *rom_path, int port, int thread_count)
+{
+  if (thread_count < 1) { thread_count = 1; }
+  if (thread_count > MAX_THREADS) { thread_count = MAX_THREADS; }
+
+  if (FrontDoor::init(rom_path, port) != 0) { return -1; }
+
+  running = true;
+
+  for (int n = 0; n < thread_count; n++)
+  {
+    workers[n] = std::thread(&SessionServer::run_worker, this);
+  }
+
+  this->thread_count = thread_count;
+
+  printf("Running games on %d threads.\n", thread_count);
+
+  return 0;
+}
+
+void SessionServer::service(int fd)
+{
+  // Something is ready in a Session's own epoll.
+  Slot *slot = find_session_fd(fd);
+
+  if (slot != nullptr)
+  {
+    slot->session->get_television()->service_network();
+  }
+}
+
+void SessionServer::run_worker()
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (running)
+  {
+    Slot *next = nullptr;
+
+    for (int n = 0; n < MAX_SESSIONS; n++)
+    {
+      Slot &slot = slots[n];
+
+      if (slot.session == nullptr || slot.busy || slot.finished) { continue; }
+
+      if (next == nullptr || slot.deadline < next->deadline) { next = &slot; }
+    }
+
+    if (next == nullptr)
+    {
+      wake_workers.wait_for(guard, std::chrono::milliseconds(100));
+      continue;
+    }
+
+    const int64_t now = FramePacer::get_time();
+
+    // This is woken up early if a new Session starts, so it looks again
+    // either way.
+    if (next->deadline > now)
+    {
+      wake_workers.wait_for(
+        guard,
+        std::chrono::nanoseconds(next->deadline - now));
+      continue;
+    }
+
+    Session *session = next->session;
+    next->busy = true;
+
+    guard.unlock();
+
+    const bool alive = session->run_frame();
+    const int64_t deadline =
+      session->get_television()->get_pacer()->next_deadline();
+
+    guard.lock();
+
+    next->busy = false;
+    next->deadline = deadline;
+    if (!alive) { next->finished = true; }
+  }
+}
+
+int SessionServer::route(Pending &pending, const char *path)
+{
+  return route_game(pending, path);
+}
+
+int SessionServer::join_game(int id, Pending &pending)
+{
+  Slot *slot = find_session(id);
+
+  return slot->session->get_television()->add_client(
+    pending.fd,
+    pending.input,
+    pending.input_length);
+}
+
+int SessionServer::start_game(const char *name)
+{
+  // Returns the id of the new Session, -1 if the ROM couldn't be loaded
+  // or -2 if the server is full.
+  char filename[512];
+  Slot *slot = nullptr;
+
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    if (slots[n].session == nullptr)
+    {
+      slot = &slots[n];
+      break;
+    }
+  }
+
+  if (slot == nullptr)
+  {
+    printf("Too many sessions.\n");
+    return -2;
+  }
+
+  snprintf(filename, sizeof(filename), "%s/%s", directory, name);
+
+  Session *session = new Session(next_id);
+
+  if (session->init(filename) != 0 ||
+      net_watch(session->get_television()->get_network_fd()) != 0)
+  {
+    delete session;
+    return -1;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+
+    slot->session = session;
+    slot->deadline = FramePacer::get_time();
+    slot->busy = false;
+    slot->finished = false;
+  }
+
+  wake_workers.notify_one();
+
+  printf("Session %d started: %s\n", next_id, name);
+
+  return next_id++;
+}
+
+SessionServer::Slot *SessionServer::find_session(int id)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    Slot &slot = slots[n];
+
+    if (slot.session == nullptr || slot.finished) { continue; }
+    if (slot.session->get_id() == id) { return &slot; }
+  }
+
+  return nullptr;
+}
+
+SessionServer::Slot *SessionServer::find_session_fd(int fd)
+{
+  // Only this thread adds or removes Sessions, so this doesn't need the
+  // lock.
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    Session *session = slots[n].session;
+
+    if (session == nullptr) { continue; }
+    if (session->get_television()->get_network_fd() == fd)
+    {
+      return &slots[n];
+    }
+  }
+
+  return nullptr;
+}
+
+void SessionServer::check_pending()
+{
+  const time_t now = time(NULL);
+
+  for (int n = 0; n < MAX_SESSIONS; n++)
+  {
+    Slot &slot = slots[n];
+    Session *session = slot.session;
+    bool finished;
+
+    if (session == nullptr) { continue; }
+
+    {
+      std::lock_guard<std::mutex> guard(lock);
+
+      finished = slot.finished && !slot.busy;
+
+      if (finished) { slot.session = nullptr; }
+    }
+
+    if (finished)
+    {
+      FramePacer *pacer = session->get_television()->get_pacer();
+
+      printf("Session %d finished: %" PRId64 " frames, %" PRId64 " late\n",
+        session->get_id(),
+        pacer->get_frames(),
+        pacer->get_late_frames());
+
+      net_unwatch(session->get_television()->get_network_fd());
+      delete session;
+      continue;
+    }
+
+    // A Session only sees that nobody is connected to it anymore when
+    // its network is serviced, so each one gets a turn every second.
+    if (now != last_check) { session->get_television()->service_network(); }
+  }
+
+  FrontDoor::check_pending();
+}
+
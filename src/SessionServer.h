@@ -0,0 +1,90 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * SessionServer runs many games in one process on one port, instead of
+ * a process (and a port) for each game. It's a FrontDoor that hands the
+ * connections to its own Sessions instead of other processes.
+ *
+ * GET /play?game.bin starts a Session with that ROM from the ROM
+ * directory and redirects the browser to /id/ (see route_game()), where
+ * the Session's TelevisionHttp serves the same page as the http mode. The network
+ * thread reads the first line of each new connection and hands it to
+ * the Session it's for. The Sessions' own epoll descriptors are in the
+ * server's epoll, so the same thread does all of their network I/O.
+ *
+ * A fixed number of worker threads run the games. Each worker takes the
+ * Session with the earliest deadline, waits until it's due, runs one
+ * frame and schedules the next one with the Session's FramePacer.
+ *
+ */
+
+#ifndef SESSION_SERVER_H
+#define SESSION_SERVER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "FrontDoor.h"
+#include "Session.h"
+
+class SessionServer : public FrontDoor
+{
+public:
+  SessionServer();
+  virtual ~SessionServer();
+
+  int init(const char *rom_path, int port, int thread_count);
+
+protected:
+  virtual int route(Pending &pending, const char *path);
+  virtual void check_pending();
+  virtual void service(int fd);
+  virtual int start_game(const char *name);
+  virtual bool has_game(int id) { return find_session(id) != nullptr; }
+  virtual int join_game(int id, Pending &pending);
+
+private:
+  struct Slot
+  {
+    Session *session;
+    int64_t deadline;
+
+    // A worker is running it.
+    bool busy;
+
+    // The game is over and the network thread can delete it.
+    bool finished;
+  };
+
+  void run_worker();
+  Slot *find_session(int id);
+  Slot *find_session_fd(int fd);
+
+  static const int MAX_SESSIONS = 64;
+  static const int MAX_THREADS = 64;
+
+  int next_id;
+  int thread_count;
+
+  // Guards the slots shared by the network thread and the workers. Only
+  // the network thread adds and deletes Sessions.
+  std::mutex lock;
+  std::condition_variable wake_workers;
+  std::atomic<bool> running;
+  Slot slots[MAX_SESSIONS];
+
+  std::thread workers[MAX_THREADS];
+};
+
+#endif
+
@@ -0,0 +1,219 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "ROM.h"
+#include "SnapshotCache.h"
+#include "TelevisionNull.h"
+#include "TIA.h"
+
+void SnapshotCache::boot(M6502 *m6502, MemoryBus *memory_bus)
+{
+  // Call this right after reset() with the Television already set.
+  char directory[192];
+  char filename[256];
+  SaveState::Image image;
+
+  // Without a safe place for the files it still skips the boot, it just
+  // has to run it every time.
+  const bool cache = get_directory(directory, sizeof(directory)) == 0;
+
+  snprintf(filename, sizeof(filename), "%s/%016" PRIx64 ".snap",
+    directory, memory_bus->get_rom()->get_hash());
+
+  if (cache && load(filename, m6502, memory_bus) == 0) { return; }
+
+  // The padding goes in the file too.
+  memset((void *)&image, 0, sizeof(image));
+
+  const int frames = run(m6502, memory_bus, image);
+
+  if (cache && save(filename, image) == 0)
+  {
+    printf("Saved snapshot %s after %d frames.\n", filename, frames);
+  }
+
+  SaveState::restore(m6502, memory_bus, image);
+}
+
+int SnapshotCache::run(
+  M6502 *m6502,
+  MemoryBus *memory_bus,
+  SaveState::Image &image)
+{
+  // Returns the number of frames before the one where the game first
+  // read any input, with image set to the start of that frame.
+  TIA *tia = memory_bus->get_tia();
+  Television *television = tia->get_television();
+  TelevisionNull television_null;
+  const uint64_t end = m6502->get_total_cycles() + MAX_BOOT_CYCLES;
+  int frames = 0;
+
+  television_null.init();
+  tia->set_television(&television_null);
+
+  SaveState::save(m6502, memory_bus, image);
+  memory_bus->clear_input_read();
+
+  while (m6502->is_running() && m6502->get_total_cycles() < end)
+  {
+    m6502->step();
+
+    tia->need_check_events();
+
+    if (memory_bus->was_input_read()) { break; }
+
+    if (television_null.get_frame_count() != frames)
+    {
+      frames = television_null.get_frame_count();
+
+      SaveState::save(m6502, memory_bus, image);
+
+      if (frames == MAX_BOOT_FRAMES) { break; }
+    }
+  }
+
+  tia->set_television(television);
+
+  return frames;
+}
+
+int SnapshotCache::load(
+  const char *filename,
+  M6502 *m6502,
+  MemoryBus *memory_bus)
+{
+  // Restores the snapshot straight from the file. Returns -1 if there's
+  // no good snapshot for this ROM.
+  struct stat statbuf;
+
+  const int fd = open(filename, O_RDONLY);
+
+  if (fd == -1) { return -1; }
+
+  if (fstat(fd, &statbuf) != 0 || statbuf.st_size == 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (data == MAP_FAILED) { return -1; }
+
+  const SaveState::Image *image =
+    SaveState::check(memory_bus, data, statbuf.st_size);
+
+  if (image != nullptr) { SaveState::restore(m6502, memory_bus, *image); }
+
+  munmap(data, statbuf.st_size);
+
+  return image != nullptr ? 0 : -1;
+}
+
+int SnapshotCache::save(const char *filename, const SaveState::Image &image)
+{
+  char temp[280];
+
+  // Other games booting the same ROM at the same time, in this process
+  // or another, only ever see the whole file or none of it.
+  snprintf(temp, sizeof(temp), "%s.XXXXXX", filename);
+
+  const int fd = mkstemp(temp);
+  FILE *out = fd == -1 ? NULL : fdopen(fd, "wb");
+
+  if (out == NULL)
+  {
+    printf("Error: Couldn't write snapshot %s\n", temp);
+
+    if (fd != -1)
+    {
+      close(fd);
+      unlink(temp);
+    }
+
+    return -1;
+  }
+
+  const bool written = fwrite(&image, sizeof(image), 1, out) == 1;
+
+  if (fclose(out) != 0 || !written || rename(temp, filename) != 0)
+  {
+    printf("Error: Couldn't write snapshot %s\n", filename);
+    unlink(temp);
+    return -1;
+  }
+
+  return 0;
+}
+
+int SnapshotCache::get_directory(char *directory, int length)
+{
+  // The snapshots are restored without question, so they're kept where
+  // only this user can write: $CLOUDTARI_SNAPSHOTS, or the user's cache
+  // directory. Returns -1 if there's no such place.
+  const char *path = getenv("CLOUDTARI_SNAPSHOTS");
+  const char *cache = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  struct stat statbuf;
+
+  directory[0] = 0;
+
+  if (path != NULL && path[0] != 0)
+  {
+    snprintf(directory, length, "%s", path);
+  }
+    else
+  if (cache != NULL && cache[0] == '/')
+  {
+    snprintf(directory, length, "%s/cloudtari", cache);
+  }
+    else
+  if (home != NULL && home[0] == '/')
+  {
+    // $HOME/.cache is made first if it's not there yet.
+    snprintf(directory, length, "%s/.cache", home);
+    mkdir(directory, 0700);
+    snprintf(directory, length, "%s/.cache/cloudtari", home);
+  }
+    else
+  {
+    return -1;
+  }
+
+  mkdir(directory, 0700);
+
+  if (lstat(directory, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode))
+  {
+    return -1;
+  }
+
+  if (statbuf.st_uid != getuid() || (statbuf.st_mode & 0022) != 0)
+  {
+    printf("Not using snapshots in %s: it has to be a directory only "
+           "this user can write to.\n", directory);
+    return -1;
+  }
+
+  return 0;
+}
+
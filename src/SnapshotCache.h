@@ -0,0 +1,65 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * SnapshotCache skips the part of a game's boot that's the same every
+ * time. The first time a ROM is played, boot() runs it with a
+ * TelevisionNull as fast as it goes until the game first reads the
+ * joysticks, switches or paddles. The state of the machine at the start
+ * of that frame is saved in a file named after a hash of the ROM, and
+ * after that boot() loads it instead of running all those frames again.
+ * The file is a SaveState::Image, restored straight from an mmap().
+ *
+ * Nothing the player does can change what happens before the game
+ * reads any input, so starting from the snapshot plays out exactly the
+ * same as starting from reset.
+ *
+ * The files go in $CLOUDTARI_SNAPSHOTS, or $XDG_CACHE_HOME/cloudtari,
+ * or $HOME/.cache/cloudtari. Since a file there is restored without any
+ * more checks than SaveState::check(), the directory isn't used unless
+ * it belongs to this user and nobody else can write to it. Deleting the
+ * files is always safe.
+ *
+ */
+
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include <stdint.h>
+
+#include "M6502.h"
+#include "MemoryBus.h"
+#include "SaveState.h"
+
+class SnapshotCache
+{
+public:
+  static void boot(M6502 *m6502, MemoryBus *memory_bus);
+
+private:
+  SnapshotCache() { }
+  ~SnapshotCache() { }
+
+  static int run(
+    M6502 *m6502,
+    MemoryBus *memory_bus,
+    SaveState::Image &image);
+  static int load(const char *filename, M6502 *m6502, MemoryBus *memory_bus);
+  static int save(const char *filename, const SaveState::Image &image);
+  static int get_directory(char *directory, int length);
+
+  // Games that still haven't read any input after this long (10 seconds)
+  // are snapshotted where they are.
+  static const int MAX_BOOT_FRAMES = 600;
+
+  // Or if it never finishes a frame, this many cycles.
+  static const uint64_t MAX_BOOT_CYCLES = 76 * 262 * MAX_BOOT_FRAMES;
+};
+
+#endif
+
@@ -20,9 +20,10 @@
 TIA::TIA() :
   pos_x{0},
   pos_y{0},
-  hsync_latch{false},
-  image_32{nullptr},
-  image_8{nullptr},
+  cycle{0},
+  stall_until{0},
+  reference_renderer{false},
+  frame{nullptr},
   check_events{false},
   fps{0},
   timestamp{0}
@@ -36,6 +37,20 @@ TIA::TIA() :
        ((n & 0x40) >> 5) | ((n & 0x80) >> 7));
   }
 
+  for (int n = 0; n < 256; n++)
+  {
+    scale_2[n] = 0;
+    scale_4[n] = 0;
+
+    for (int b = 0; b < 8; b++)
+    {
+      if ((n & (1 << b)) == 0) { continue; }
+
+      scale_2[n] |= 0x3 << (b * 2);
+      scale_4[n] |= 0xf << (b * 4);
+    }
+  }
+
   reset();
 }
 
@@ -47,7 +62,8 @@ void TIA::reset()
 {
   pos_x = 0;
   pos_y = 0;
-  hsync_latch = false;
+  cycle = 0;
+  stall_until = 0;
 
   playfield.reset();
 
@@ -58,6 +74,65 @@ void TIA::reset()
   read_regs[INPT5] = 0x80;
 }
 
+void TIA::save_state(State &state)
+{
+  state.cycle = cycle;
+  state.stall_until = stall_until;
+  state.pos_x = pos_x;
+  state.pos_y = pos_y;
+  state.playfield = playfield;
+  state.player_0 = player_0;
+  state.player_1 = player_1;
+  state.missile_0 = missile_0;
+  state.missile_1 = missile_1;
+  state.ball = ball;
+  memcpy(state.write_regs, write_regs, sizeof(state.write_regs));
+  memcpy(state.read_regs, read_regs, sizeof(state.read_regs));
+}
+
+void TIA::load_state(const State &state)
+{
+  cycle = state.cycle;
+  stall_until = state.stall_until;
+  pos_x = state.pos_x;
+  pos_y = state.pos_y;
+  playfield = state.playfield;
+  player_0 = state.player_0;
+  player_1 = state.player_1;
+  missile_0 = state.missile_0;
+  missile_1 = state.missile_1;
+  ball = state.ball;
+  memcpy(write_regs, state.write_regs, sizeof(write_regs));
+  memcpy(read_regs, state.read_regs, sizeof(read_regs));
+}
+
+bool TIA::check_state(const State &state)
+{
+  // A state from a file could have anything in it. These are the values
+  // the TIA trusts enough to draw into the frame or divide by.
+  if (state.pos_x < 0 || state.pos_x >= 68 + 160) { return false; }
+  if (state.pos_y < 0 || state.pos_y > 262) { return false; }
+
+  const Player *players[] = { &state.player_0, &state.player_1 };
+  const Sprite *sprites[] = { &state.missile_0, &state.missile_1, &state.ball };
+
+  for (int n = 0; n < 2; n++)
+  {
+    const int scale = players[n]->scale;
+
+    if (scale != 1 && scale != 2 && scale != 4) { return false; }
+  }
+
+  for (int n = 0; n < 3; n++)
+  {
+    const int width = sprites[n]->width;
+
+    if (width != 1 && width != 2 && width != 4 && width != 8) { return false; }
+  }
+
+  return true;
+}
+
 uint8_t TIA::read_memory(int address)
 {
   if (address > 0x0d) { return 0; }
@@ -79,9 +154,6 @@ void TIA::write_memory(int address, uint8_t value)
         television->refresh();
         pos_x = 0;
         pos_y = 0;
-
-        // In case the Television is page flipping.
-        set_image();
       }
 
       write_regs[VSYNC] = value;
@@ -90,15 +162,9 @@ void TIA::write_memory(int address, uint8_t value)
       break;
     case WSYNC:
       // This one pauses the CPU until the "video beam" starts back over
-      // at 0. This is usually done by an "sta WSYNC" instruction which is
-      // 2 CPU cycles (6 TIA cycles). The issue it seems like the CPU should
-      // be halted after the instruction finishes (hence hsync_latch variable
-      // which will pause it after the TIA runs the 6 pixel clocks). If it's
-      // halted here and between those 6 cycles in the TIA it resets to 0
-      // it seems like the CPU could unhalt early. However, with the latch
-      // code it seems to cause video glitches, so it's commented out for now.
-      write_regs[WSYNC] = 1;
-      //hsync_latch = true;
+      // at 0. Since the TIA has been synced to the cycle of the write,
+      // the number of CPU cycles left on this scanline is known here.
+      stall_until = cycle + ((68 + 160 - pos_x + 2) / 3);
       break;
     case RSYNC:
       // "This address resets the horizontal sync counter to define the
@@ -145,25 +211,27 @@ void TIA::write_memory(int address, uint8_t value)
       write_regs[address] = value;
       build_playfield();
       break;
+    // For some reason (according to some forum) the TIA delays setting the
+    // X position for player sprites by 5 TIA clocks and ball / missile by 4.
     case RESP0:
       // Reset player 0 (aka, start drawing).
-      player_0.set_position();
+      player_0.set_position(pos_x + 5);
       break;
     case RESP1:
       // Reset player 1 (aka, start drawing).
-      player_1.set_position();
+      player_1.set_position(pos_x + 5);
       break;
     case RESM0:
       // Reset missile 0.
-      missile_0.set_position();
+      missile_0.set_position(pos_x + 4);
       break;
     case RESM1:
       // Reset missile 1.
-      missile_1.set_position();
+      missile_1.set_position(pos_x + 4);
       break;
     case RESBL:
       // Reset ball.
-      ball.set_position();
+      ball.set_position(pos_x + 4);
       break;
     case AUDC0:
     case AUDC1:
@@ -307,60 +375,73 @@ void TIA::clock()
 
   pos_x++;
 
-  if (pos_x == 68 + 160)
-  {
-    if (player_0.need_update) { build_player_0(); }
-    if (player_1.need_update) { build_player_1(); }
+  if (pos_x == 68 + 160) { end_line(); }
+}
+
+void TIA::sync(uint64_t cycle)
+{
+  if (cycle <= this->cycle) { return; }
+
+  // Every CPU cycle is 3 pixels.
+  uint64_t ticks = (cycle - this->cycle) * 3;
 
-    if (!hsync_latch) { write_regs[WSYNC] = 0; }
+  this->cycle = cycle;
 
-#if 0
-    if (pos_y >= 40 && pos_y <= 232)
+  if (reference_renderer)
+  {
+    while (ticks > 0)
     {
-      television->refresh();
+      clock();
+      ticks--;
     }
-#endif
 
-    if (pos_y < 40 && (pos_y & 0xf) == 0) { check_events = true; }
+    return;
+  }
+
+  // No registers change between syncs, so everything up to the end of
+  // the scanline (or the end of this sync) can be drawn in one span.
+  // HBLANK and VBLANK are skipped without drawing anything.
+  while (ticks > 0)
+  {
+    const int count = ticks < (uint64_t)(68 + 160 - pos_x) ?
+      ticks : 68 + 160 - pos_x;
+
+    if (pos_y >= 40 && pos_y < 232 && pos_x + count > 68)
+    {
+      render_span(pos_x < 68 ? 68 : pos_x, pos_x + count);
+    }
 
-    pos_x = 0;
-    pos_y++;
+    pos_x += count;
+    ticks -= count;
 
-    // This really shouldn't be needed.. but..
-    if (pos_y > 262) { pos_y = 0; }
+    if (pos_x == 68 + 160) { end_line(); }
   }
 }
 
-void TIA::clock(int ticks)
+void TIA::end_line()
 {
-  // Every CPU cycle is 3 pixels.
-  ticks = ticks * 3;
+  if (player_0.need_update) { build_player_0(); }
+  if (player_1.need_update) { build_player_1(); }
 
-  while (ticks > 0)
+#if 0
+  if (pos_y >= 40 && pos_y <= 232)
   {
-    clock();
-    ticks--;
+    television->refresh();
   }
+#endif
 
-  // For some reason (according to some forum) the TIA delays setting the
-  // X position for player sprites by 5 TIA clocks and ball / missile by 4.
-  if (player_0.need_set_position())  { player_0.set_position(pos_x + 5); }
-  if (player_1.need_set_position())  { player_1.set_position(pos_x + 5); }
-  if (missile_0.need_set_position()) { missile_0.set_position(pos_x + 4); }
-  if (missile_1.need_set_position()) { missile_1.set_position(pos_x + 4); }
-  if (ball.need_set_position())      { ball.set_position(pos_x + 4); }
+  if (pos_y < 40 && (pos_y & 0xf) == 0) { check_events = true; }
 
-  if (hsync_latch)
-  {
-    write_regs[WSYNC] = 1;
-    hsync_latch = false;
-  }
+  pos_x = 0;
+  pos_y++;
+
+  // This really shouldn't be needed.. but..
+  if (pos_y > 262) { pos_y = 0; }
 }
 
 void TIA::dump()
 {
-  printf("TIA: pos_x=%d pos_y=%d  wait_for_hsync=%s\n",
-    pos_x, pos_y, wait_for_hsync() ? "on" : "off");
+  printf("TIA: pos_x=%d pos_y=%d\n", pos_x, pos_y);
 
   printf("playfield: ");
   for (int n = 0; n < 40; n++)
@@ -528,3 +609,242 @@ void TIA::compute_collisions()
   read_regs[CXPPMM] |= ((p0 & p1) << 7) | ((m0 & m1) << 6);
 }
 
+void TIA::render_span(int start, int end)
+{
+  // Gives the same result as running clock() from pos_x = start to
+  // end - 1. Every object is turned into a 160 bit mask of the pixels it
+  // covers on this line, collisions are found by ANDing the masks, and
+  // the colors are blended together in priority order. The frame holds
+  // ColorTable indexes which are the TIA colors >> 1.
+  LineMask span, pf, p0, p1, m0, m1, bl;
+  const uint64_t pf_data = playfield.data;
+
+  span.set_range(start - 68, end - 68);
+
+  pf.bits[0] =
+     (uint64_t)scale_4[(pf_data >> 0) & 0xff] |
+    ((uint64_t)scale_4[(pf_data >> 8) & 0xff] << 32);
+  pf.bits[1] =
+     (uint64_t)scale_4[(pf_data >> 16) & 0xff] |
+    ((uint64_t)scale_4[(pf_data >> 24) & 0xff] << 32);
+  pf.bits[2] =
+     (uint64_t)scale_4[(pf_data >> 32) & 0xff];
+
+  build_player_mask(p0, player_0);
+  build_player_mask(p1, player_1);
+  build_sprite_mask(m0, missile_0);
+  build_sprite_mask(m1, missile_1);
+  build_sprite_mask(bl, ball);
+
+  read_regs[CXM0P] |=
+    (m0.overlaps(p1, span) << 7) | (m0.overlaps(p0, span) << 6);
+  read_regs[CXM1P] |=
+    (m1.overlaps(p0, span) << 7) | (m1.overlaps(p1, span) << 6);
+  read_regs[CXP0FB] |=
+    (p0.overlaps(pf, span) << 7) | (p0.overlaps(bl, span) << 6);
+  read_regs[CXP1FB] |=
+    (p1.overlaps(pf, span) << 7) | (p1.overlaps(bl, span) << 6);
+  read_regs[CXM0FB] |=
+    (m0.overlaps(pf, span) << 7) | (m0.overlaps(bl, span) << 6);
+  read_regs[CXM1FB] |=
+    (m1.overlaps(pf, span) << 7) | (m1.overlaps(bl, span) << 6);
+  read_regs[CXBLPF] |=
+    (bl.overlaps(pf, span) << 7);
+  read_regs[CXPPMM] |=
+    (p0.overlaps(p1, span) << 7) | (m0.overlaps(m1, span) << 6);
+
+  // Player 0 and missile 0 share a color, as do player 1 / missile 1 and
+  // playfield / ball.
+  const LineMask mask_0 = p0 | m0;
+  const LineMask mask_1 = p1 | m1;
+  const LineMask mask_pf = pf | bl;
+  const int y = get_y();
+
+  uint8_t line[160];
+
+  if ((write_regs[CTRLPF] & 4) == 0)
+  {
+    // Sprites have priority.
+    compose(line, start - 68, end - 68,
+      mask_pf, mask_1, mask_0,
+      write_regs[COLUBK] >> 1,
+      write_regs[COLUPF] >> 1,
+      write_regs[COLUP1] >> 1,
+      write_regs[COLUP0] >> 1);
+  }
+    else
+  {
+    // Playfield has priority.
+    compose(line, start - 68, end - 68,
+      mask_1, mask_0, mask_pf,
+      write_regs[COLUBK] >> 1,
+      write_regs[COLUP1] >> 1,
+      write_regs[COLUP0] >> 1,
+      write_regs[COLUPF] >> 1);
+  }
+
+  memcpy(
+    frame + (y * Television::FRAME_WIDTH) + (start - 68),
+    line + (start - 68),
+    end - start);
+}
+
+void TIA::build_player_mask(LineMask &mask, const Player &player)
+{
+  uint64_t pattern;
+
+  switch (player.scale)
+  {
+    case 1:  pattern = player.data; break;
+    case 2:  pattern = scale_2[player.data]; break;
+    default: pattern = scale_4[player.data]; break;
+  }
+
+  mask.set(player.start_pos - 68, pattern);
+}
+
+void TIA::build_sprite_mask(LineMask &mask, const Sprite &sprite)
+{
+  if (!sprite.enabled) { return; }
+
+  mask.set(sprite.start_pos - 68, (1ULL << sprite.width) - 1);
+}
+
+#if defined(__AVX2__)
+// Turns 32 bits into 32 bytes of 0x00 / 0xff.
+static inline __m256i expand(uint32_t bits)
+{
+  const __m256i shuffle = _mm256_setr_epi8(
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i select = _mm256_set1_epi64x(0x8040201008040201ULL);
+
+  __m256i value = _mm256_set1_epi32(bits);
+  value = _mm256_shuffle_epi8(value, shuffle);
+
+  return _mm256_cmpeq_epi8(_mm256_and_si256(value, select), select);
+}
+#elif defined(__SSE2__)
+// Turns 16 bits into 16 bytes of 0x00 / 0xff.
+static inline __m128i expand(uint32_t bits)
+{
+  const __m128i select = _mm_set1_epi64x(0x8040201008040201ULL);
+
+  __m128i value = _mm_cvtsi32_si128(bits);
+  value = _mm_unpacklo_epi8(value, value);
+  value = _mm_unpacklo_epi16(value, value);
+  value = _mm_unpacklo_epi32(value, value);
+
+  return _mm_cmpeq_epi8(_mm_and_si128(value, select), select);
+}
+
+static inline __m128i blend(__m128i a, __m128i b, __m128i mask)
+{
+  return _mm_or_si128(_mm_and_si128(mask, b), _mm_andnot_si128(mask, a));
+}
+#endif
+
+void TIA::compose(
+  uint8_t *line,
+  int start,
+  int end,
+  const LineMask &low,
+  const LineMask &middle,
+  const LineMask &high,
+  uint8_t color_bk,
+  uint8_t color_low,
+  uint8_t color_middle,
+  uint8_t color_high)
+{
+  // Each pixel is color_bk unless covered by one of the masks. The masks
+  // are applied lowest priority first so higher ones overwrite them.
+  // The vector code fills whole 16 or 32 pixel blocks of line[], which
+  // is fine since only start to end - 1 is used.
+#if defined(__AVX2__)
+  const __m256i bk = _mm256_set1_epi8(color_bk);
+  const __m256i c_low = _mm256_set1_epi8(color_low);
+  const __m256i c_middle = _mm256_set1_epi8(color_middle);
+  const __m256i c_high = _mm256_set1_epi8(color_high);
+
+  for (int x = start & ~31; x < end; x += 32)
+  {
+    __m256i color = bk;
+    color = _mm256_blendv_epi8(color, c_low, expand(low.get_32(x)));
+    color = _mm256_blendv_epi8(color, c_middle, expand(middle.get_32(x)));
+    color = _mm256_blendv_epi8(color, c_high, expand(high.get_32(x)));
+
+    _mm256_storeu_si256((__m256i *)(line + x), color);
+  }
+#elif defined(__SSE2__)
+  const __m128i bk = _mm_set1_epi8(color_bk);
+  const __m128i c_low = _mm_set1_epi8(color_low);
+  const __m128i c_middle = _mm_set1_epi8(color_middle);
+  const __m128i c_high = _mm_set1_epi8(color_high);
+
+  for (int x = start & ~15; x < end; x += 16)
+  {
+    __m128i color = bk;
+    color = blend(color, c_low, expand(low.get_16(x)));
+    color = blend(color, c_middle, expand(middle.get_16(x)));
+    color = blend(color, c_high, expand(high.get_16(x)));
+
+    _mm_storeu_si128((__m128i *)(line + x), color);
+  }
+#else
+  for (int x = start; x < end; x++)
+  {
+    const uint64_t bit = 1ULL << (x & 63);
+    const int n = x >> 6;
+
+    if ((high.bits[n] & bit) != 0)        { line[x] = color_high; }
+    else if ((middle.bits[n] & bit) != 0) { line[x] = color_middle; }
+    else if ((low.bits[n] & bit) != 0)    { line[x] = color_low; }
+    else                                  { line[x] = color_bk; }
+  }
+#endif
+}
+
+void TIA::LineMask::set(int x, uint64_t pattern)
+{
+  // Puts pattern (up to 32 pixels wide) at x, clipped to the 160 pixels.
+  if (x < 0)
+  {
+    if (x <= -32) { return; }
+    pattern >>= -x;
+    x = 0;
+  }
+
+  if (x >= 160) { return; }
+
+  const int n = x >> 6;
+  const int shift = x & 63;
+
+  bits[n] |= pattern << shift;
+
+  if (shift != 0 && n < 2) { bits[n + 1] |= pattern >> (64 - shift); }
+}
+
+void TIA::LineMask::set_range(int start, int end)
+{
+  for (int n = 0; n < 3; n++)
+  {
+    const int low = start - (n * 64);
+    const int high = end - (n * 64);
+
+    if (high <= 0 || low >= 64) { continue; }
+
+    uint64_t value = ~0ULL;
+
+    if (high < 64) { value &= (1ULL << high) - 1; }
+    if (low > 0) { value &= ~((1ULL << low) - 1); }
+
+    bits[n] |= value;
+  }
+}
+
+bool TIA::LineMask::overlaps(const LineMask &mask, const LineMask &span) const
+{
+  return ((bits[0] & mask.bits[0] & span.bits[0]) |
+          (bits[1] & mask.bits[1] & span.bits[1]) |
+          (bits[2] & mask.bits[2] & span.bits[2])) != 0;
+}
@@ -18,7 +18,9 @@
  * Visible Resolution: 160x192
  *
  * For every 1 CPU cycle taken, the TIA will have taken 3 clocks (3 pixels
- * drawn on the screen).
+ * drawn on the screen). The TIA isn't clocked after every instruction.
+ * Instead sync() catches it up to the CPU's cycle count right before one
+ * of its registers is accessed.
  *
  */
 
@@ -28,6 +30,12 @@
 #include <stdint.h>
 #include <time.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "ColorTable.h"
 #include "Television.h"
 
@@ -41,9 +49,11 @@ public:
   uint8_t read_memory(int address);
   void write_memory(int address, uint8_t value);
   void clock();
-  void clock(int ticks);
+  void sync(uint64_t cycle);
+  void set_reference_renderer(bool value) { reference_renderer = value; }
+  void reset_cycle() { cycle = 0; stall_until = 0; }
+  uint64_t get_stall_until() { return stall_until; }
   void dump();
-  bool wait_for_hsync() { return write_regs[WSYNC] != 0; }
   void set_joystick_0_fire() { read_regs[INPT4] &= 0x7f; }
   void set_joystick_1_fire() { read_regs[INPT5] &= 0x7f; }
   void clear_joystick_0_fire() { read_regs[INPT4] |= 0x80; }
@@ -56,25 +66,14 @@ public:
     return value;
   }
 
-  void set_image()
-  {
-    if (bitsize == 8)
-    {
-      image_8 = (uint8_t *)television->get_image();
-    }
-      else
-    {
-      image_32 = (uint32_t *)television->get_image();
-    }
-  }
-
   void set_television(Television *television)
   {
     this->television = television;
-    bitsize = television->get_bitsize();
-    set_image();
+    frame = television->get_frame();
   }
 
+  Television *get_television() { return television; }
+
   int compute_offset(int value)
   {
     int8_t offset = (int8_t)value;
@@ -109,7 +108,6 @@ private:
   {
     Player() :
       data{0},
-      set_pos{false},
       vertical_delay{false},
       need_update{false},
       scale{1},
@@ -119,13 +117,11 @@ private:
     }
 
     void reset() { start_pos = 0; }
-    void set_position() { set_pos = true; }
-    void set_position(int pos_x) { start_pos = pos_x; set_pos = false; }
+    void set_position(int pos_x) { start_pos = pos_x; }
     void set_scale(int value) { scale = value; }
     void set_move(int value) { move = value; }
     void apply_move() { start_pos -= move; }
     void clear_move() { move = 0; }
-    bool need_set_position() { return set_pos; }
     bool is_pixel_on() { return pixel_value; }
 
     void compute_pixel(int pos_x)
@@ -138,7 +134,6 @@ private:
     }
 
     uint8_t data;
-    bool set_pos;
     bool vertical_delay;
     bool need_update;
     bool pixel_value;
@@ -149,21 +144,18 @@ private:
   {
     Sprite() :
       width{1},
-      set_pos{false},
       enabled{false},
       start_pos{0}
     {
     }
 
     void reset() { start_pos = 0; }
-    void set_position() { set_pos = true; }
-    void set_position(int pos_x) { start_pos = pos_x; set_pos = false; }
+    void set_position(int pos_x) { start_pos = pos_x; }
     void set_width(int value) { width = value; }
     void set_move(int value) { move = value; }
     void apply_move() { start_pos -= move; }
     void clear_move() { move = 0; }
     void set_enabled(bool value) { enabled = value; }
-    bool need_set_position() { return set_pos; }
     bool is_pixel_on() { return pixel_value; }
 
     void compute_pixel(int pos_x)
@@ -175,7 +167,6 @@ private:
     }
 
     uint8_t width;
-    bool set_pos;
     bool enabled;
     bool pixel_value;
     int start_pos, move;
@@ -192,6 +183,53 @@ private:
     bool vertical_delay;
   };
 
+  // One bit per pixel of the 160 pixel visible part of a scanline.
+  struct LineMask
+  {
+    LineMask() : bits{0, 0, 0} { }
+
+    void set(int x, uint64_t pattern);
+    void set_range(int start, int end);
+    bool overlaps(const LineMask &mask, const LineMask &span) const;
+    uint32_t get_16(int x) const { return (bits[x >> 6] >> (x & 63)) & 0xffff; }
+    uint32_t get_32(int x) const { return bits[x >> 6] >> (x & 63); }
+
+    LineMask operator|(const LineMask &mask) const
+    {
+      LineMask value;
+      value.bits[0] = bits[0] | mask.bits[0];
+      value.bits[1] = bits[1] | mask.bits[1];
+      value.bits[2] = bits[2] | mask.bits[2];
+      return value;
+    }
+
+    uint64_t bits[3];
+  };
+
+public:
+  // Everything that changes as a game runs, for SnapshotCache. The frame
+  // isn't kept since snapshots are taken as a new frame starts.
+  struct State
+  {
+    uint64_t cycle;
+    uint64_t stall_until;
+    int32_t pos_x;
+    int32_t pos_y;
+    Playfield playfield;
+    Player player_0;
+    Player player_1;
+    Missile missile_0;
+    Missile missile_1;
+    Ball ball;
+    uint8_t write_regs[64];
+    uint8_t read_regs[16];
+  };
+
+  void save_state(State &state);
+  void load_state(const State &state);
+  bool check_state(const State &state);
+
+private:
   int get_x() { return pos_x - 68; }
   int get_y() { return pos_y - 40; }
   void player_size(Player &player, int value);
@@ -200,37 +238,26 @@ private:
   void build_player_1();
   void draw_pixel();
   void compute_collisions();
+  void render_span(int start, int end);
+  void build_player_mask(LineMask &mask, const Player &player);
+  void build_sprite_mask(LineMask &mask, const Sprite &sprite);
+
+  static void compose(
+    uint8_t *line,
+    int start,
+    int end,
+    const LineMask &low,
+    const LineMask &middle,
+    const LineMask &high,
+    uint8_t color_bk,
+    uint8_t color_low,
+    uint8_t color_middle,
+    uint8_t color_high);
+  void end_line();
 
   inline void set_pixel(int x, int y, uint8_t color)
   {
-    x = x * 3;
-    y = y * 2;
-
-    const int width = television->get_width();
-    int ptr = y * width + x;
-
-    if (bitsize == 8)
-    {
-      color = color >> 1;
-      image_8[ptr + 0] = color;
-      image_8[ptr + 1] = color;
-      image_8[ptr + 2] = color;
-      ptr += width;
-      image_8[ptr + 0] = color;
-      image_8[ptr + 1] = color;
-      image_8[ptr + 2] = color;
-    }
-      else
-    {
-      int c = ColorTable::get_color(color);
-      image_32[ptr + 0] = c;
-      image_32[ptr + 1] = c;
-      image_32[ptr + 2] = c;
-      ptr += width;
-      image_32[ptr + 0] = c;
-      image_32[ptr + 1] = c;
-      image_32[ptr + 2] = c;
-    }
+    frame[(y * Television::FRAME_WIDTH) + x] = color >> 1;
   }
 
   // Debugging function.
@@ -261,7 +288,14 @@ private:
 
   int pos_x;
   int pos_y;
-  bool hsync_latch;
+
+  // CPU cycle the TIA has been clocked up to and, after a write to WSYNC,
+  // the CPU cycle where the next scanline starts.
+  uint64_t cycle;
+  uint64_t stall_until;
+
+  // Use clock() for every pixel instead of render_span().
+  bool reference_renderer;
 
   Playfield playfield;
   Player player_0;
@@ -274,9 +308,12 @@ private:
   uint8_t read_regs[16];
   uint8_t reverse[256];
 
-  uint32_t *image_32;
-  uint8_t *image_8;
-  int bitsize;
+  // Each bit of the index repeated 2 or 4 times.
+  uint16_t scale_2[256];
+  uint32_t scale_4[256];
+
+  // 160x192 ColorTable indexes owned by the Television.
+  uint8_t *frame;
   bool check_events;
 
   // These are for debugging frames per second.
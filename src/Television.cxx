@@ -13,14 +13,98 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "FrameHash.h"
 #include "Television.h"
 
-Television::Television() : width{480}, height{384}
+Television::Television() :
+  frame_hash{0},
+  scale_x{3},
+  scale_y{2},
+  width{480},
+  height{384},
+  hosted{false},
+  frame_done{false},
+  frames{nullptr},
+  running{false},
+  quit{false}
 {
-  memset(&refresh_time, 0, sizeof(refresh_time));
+  frame = (uint8_t *)malloc(FRAME_WIDTH * FRAME_HEIGHT);
+
+  memset(frame, 0, FRAME_WIDTH * FRAME_HEIGHT);
 }
 
 Television::~Television()
 {
+  stop_threads();
+
+  free(frame);
+}
+
+bool Television::hash_frame(const uint8_t *image)
+{
+  const uint64_t hash =
+    FrameHash::compute(image, FRAME_WIDTH * FRAME_HEIGHT);
+
+  if (hash == frame_hash) { return false; }
+
+  frame_hash = hash;
+
+  return true;
+}
+
+void Television::start_threads()
+{
+  frames = new TripleBuffer(FRAME_WIDTH * FRAME_HEIGHT);
+  running = true;
+
+  encoder_thread = std::thread(&Television::run_encoder, this);
+  network_thread = std::thread(&Television::run_network, this);
+}
+
+void Television::stop_threads()
+{
+  // Subclasses call this first in their destructor, since the threads
+  // use their members.
+  if (!running) { return; }
+
+  running = false;
+  frames->wake();
+
+  encoder_thread.join();
+  network_thread.join();
+
+  delete frames;
+  frames = nullptr;
+}
+
+void Television::publish_frame()
+{
+  if (hosted)
+  {
+    encode_frame(frame);
+    frame_done = true;
+    return;
+  }
+
+  memcpy(frames->get_back(), frame, FRAME_WIDTH * FRAME_HEIGHT);
+  frames->publish();
+}
+
+int Television::get_event()
+{
+  if (quit) { return KEY_QUIT; }
+
+  return events.pop();
+}
+
+void Television::run_encoder()
+{
+  while (running)
+  {
+    if (!frames->wait(100)) { continue; }
+    if (!frames->take()) { continue; }
+
+    encode_frame(frames->get_front());
+  }
 }
 
@@ -12,6 +12,26 @@
  * in this case being: Null (nothing), SDL (on screen), VNC (remote
  * desktop), or Http (webbrowser / GIFs).
  *
+ * The TIA draws into a native 160x192 frame of ColorTable indexes (the
+ * TIA color >> 1). Each Television scales or converts the frame in
+ * refresh() only if what it's displaying on needs it.
+ *
+ * hash_frame() lets a Television skip work when the game draws the same
+ * frame over and over, like on a title screen.
+ *
+ * Televisions that send frames over the network don't do it on the
+ * emulator thread, since refresh() is called from the middle of an
+ * instruction. Their refresh() calls publish_frame() to pass the frame
+ * through a TripleBuffer to an encoder thread that calls encode_frame()
+ * with each new one. run_network() runs on a third thread and hands
+ * keys back through an EventQueue, which handle_events() takes them
+ * from with get_event().
+ *
+ * A hosted Television belongs to a Session in a SessionServer and has
+ * no threads of its own. publish_frame() encodes the frame right away on
+ * the worker thread running the session, pause() doesn't wait, and
+ * finished_frame() tells the Session to give up the worker.
+ *
  */
 
 #ifndef TELEVISION_H
@@ -19,8 +39,14 @@
 
 #include <stdint.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <time.h>
+#include <atomic>
+#include <thread>
+
+#include "EventQueue.h"
+#include "FramePacer.h"
+#include "ImageScaler.h"
+#include "TripleBuffer.h"
 
 class Television
 {
@@ -34,40 +60,42 @@ public:
   //virtual void draw_pixel(int x, int y, uint8_t color) = 0;
   virtual bool refresh() = 0;
   virtual int handle_events() = 0;
-  virtual void *get_image() = 0;
-  virtual int get_bitsize() = 0;
   virtual void set_port(int value) { }
+  uint8_t *get_frame() { return frame; }
   int get_width() { return width; }
   int get_height() { return height; }
 
+  // Sets the size of the 32 bit image from expand_frame(). scale_x can
+  // be 1 to 3. The default is 3x2 (480x384). This has to be called
+  // before init().
+  void set_scale(int scale_x, int scale_y)
+  {
+    this->scale_x = scale_x;
+    this->scale_y = scale_y;
+    width = FRAME_WIDTH * scale_x;
+    height = FRAME_HEIGHT * scale_y;
+  }
+
+  static const int FRAME_WIDTH = 160;
+  static const int FRAME_HEIGHT = 192;
+
+  // Waits until it's time for the next frame (see FramePacer).
   void pause()
   {
-    struct timeval now;
-
-    gettimeofday(&now, NULL);
-    long time_diff = now.tv_usec - refresh_time.tv_usec;
-    while (time_diff < 0) { now.tv_sec--; time_diff += 1000000; }
-    time_diff += (now.tv_sec - refresh_time.tv_sec) * 1000000;
-
-#if 0
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    long time_diff = now.tv_nsec - refresh_time.tv_nsec;
-    while (time_diff < 0) { now.tv_sec--; time_diff += 1000000000; }
-    time_diff += (now.tv_sec - refresh_time.tv_sec) * 1000000000;
-    time_diff = time_diff / 1000;
-#endif
+    if (!hosted) { pacer.wait(); }
+  }
 
-    // 1,000,000 us / 60 fps = 16667
-    // 1,000,000 us / 30 fps = 33333
-    // FIXME: The TV should be 60fps, but for some reason 33333
-    // is coming out at 60fps in the TIA.
-    if (time_diff < 33333)
-    {
-      usleep(33333 - time_diff);
-    }
+  FramePacer *get_pacer() { return &pacer; }
 
-    refresh_time = now;
+  // This has to be called before init().
+  void set_hosted() { hosted = true; }
+
+  // Returns true once after each frame is published.
+  bool finished_frame()
+  {
+    bool value = frame_done;
+    frame_done = false;
+    return value;
   }
 
   enum
@@ -90,11 +118,46 @@ public:
   };
 
 protected:
+  // Hashes the frame (see FrameHash). Returns false if it's the same as
+  // the frame the last time this was called.
+  bool hash_frame() { return hash_frame(frame); }
+  bool hash_frame(const uint8_t *image);
+
+  // Converts and scales the frame into width x height 32 bit pixels.
+  void expand_frame(uint32_t *image) { expand_frame(image, frame); }
+
+  void expand_frame(uint32_t *image, const uint8_t *source)
+  {
+    ImageScaler::scale_image(
+      image, source, FRAME_WIDTH, FRAME_HEIGHT, scale_x, scale_y);
+  }
+
+  void start_threads();
+  void stop_threads();
+  void publish_frame();
+  int get_event();
+  virtual void encode_frame(const uint8_t *image) { }
+  virtual void run_network() { }
+
+  uint8_t *frame;
+  uint64_t frame_hash;
+  int scale_x, scale_y;
   int width, height;
-  struct timeval refresh_time;
+  FramePacer pacer;
+
+  bool hosted;
+  bool frame_done;
+
+  TripleBuffer *frames;
+  EventQueue events;
+  std::atomic<bool> running;
+  std::atomic<bool> quit;
 
 private:
+  void run_encoder();
 
+  std::thread encoder_thread;
+  std::thread network_thread;
 };
 
 #endif
@@ -12,36 +12,149 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <string>
 
 #include "ColorTable.h"
 #include "TelevisionHttp.h"
+#include "WebSocket.h"
 
-TelevisionHttp::TelevisionHttp() : gif{nullptr}, gif_length{0}, no_data_count{0}
+TelevisionHttp::TelevisionHttp() :
+  refresh_count{0},
+  frame_sequence{0},
+  control_fd{-1},
+  input_state{0},
+  image_from{0},
+  image_to{0},
+  frame_gif{nullptr},
+  frame_gif_length{0},
+  frame_gif_hash{0}
 {
+  // The GIF is sent at the native size and the browser scales it up.
+  width = FRAME_WIDTH;
+  height = FRAME_HEIGHT;
+
   gif_compressor = new GifCompressor();
   gif_compressor->set_width(width);
   gif_compressor->set_height(height);
 
-  image = (uint8_t *)malloc(width * height);
+  rle_compressor = new RleCompressor();
+  rle_compressor->set_width(width);
+  rle_compressor->set_height(height);
+
+  encoder_gif = new GifCompressor();
+  encoder_gif->set_width(width);
+  encoder_gif->set_height(height);
+
+  encoder_rle = new RleCompressor();
+  encoder_rle->set_width(width);
+  encoder_rle->set_height(height);
+
+  // The last complete frame, and the ones before it for /image.gif.
+  next_frame = (uint8_t *)malloc(width * height);
+  memset(next_frame, 0, width * height);
+
+  for (int n = 0; n < HISTORY_FRAMES; n++)
+  {
+    history[n] = (uint8_t *)malloc(width * height);
+    history_sequence[n] = -1;
+    memset(history[n], 0, width * height);
+  }
+
+  history_sequence[0] = 0;
+
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    connections[n].fd = -1;
+    connections[n].type = CONNECTION_HTTP;
+    connections[n].gif = false;
+    connections[n].spectator = false;
+    connections[n].hash = 0;
+    connections[n].synced = false;
+    connections[n].sequence = 0;
+    connections[n].input_length = 0;
+  }
+
+  for (int n = 0; n < BROADCAST_COUNT; n++)
+  {
+    broadcasts[n].frame = (uint8_t *)malloc(width * height);
+    broadcasts[n].hash = 0;
+    broadcasts[n].sent = false;
+    broadcasts[n].whole_hash = 0;
+    memset(broadcasts[n].frame, 0, width * height);
+  }
 
   memset(filename, 0, sizeof(filename));
   memset(query_string, 0, sizeof(query_string));
+  memset(websocket_key, 0, sizeof(websocket_key));
+  memset(if_none_match, 0, sizeof(if_none_match));
+  memset(etag, 0, sizeof(etag));
+  memset(base_path, 0, sizeof(base_path));
+  memset(handoff_path, 0, sizeof(handoff_path));
+  memset(&last_active, 0, sizeof(last_active));
 }
 
 TelevisionHttp::~TelevisionHttp()
 {
+  stop_threads();
+
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    if (connections[n].fd != -1) { net_disconnect(connections[n].fd); }
+  }
+
   net_close();
-  free(image);
 
   delete gif_compressor;
+  delete rle_compressor;
+  delete encoder_gif;
+  delete encoder_rle;
+
+  free(next_frame);
+  free(frame_gif);
+
+  for (int n = 0; n < BROADCAST_COUNT; n++)
+  {
+    free(broadcasts[n].frame);
+  }
+
+  for (int n = 0; n < HISTORY_FRAMES; n++)
+  {
+    free(history[n]);
+  }
 }
 
 int TelevisionHttp::init()
 {
-  if (net_open(port) != 0) { return -1; }
-  if (read_http() != 0) { return -1; }
-  if (send_index_html() != 0) { return -1; }
+  // The SessionServer sends the connections.
+  if (hosted)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &last_active);
+    return 0;
+  }
+
+  if (control_fd != -1)
+  {
+    if (net_open_control(control_fd) != 0) { return -1; }
+  }
+    else
+  if (handoff_path[0] != 0)
+  {
+    if (net_open(handoff_path) != 0) { return -1; }
+  }
+    else
+  {
+    if (net_open(port) != 0) { return -1; }
+  }
+
+  if (net_watch(socket_id) != 0) { return -1; }
+
+  // The network thread reads the rest of its request for / along with
+  // everything else.
+  adopt_connection(client, handoff_data, handoff_length);
+
+  clock_gettime(CLOCK_MONOTONIC, &last_active);
+  start_threads();
 
   return 0;
 }
@@ -84,11 +197,8 @@ void TelevisionHttp::draw_pixel(int x, int y, uint8_t color)
 
 bool TelevisionHttp::refresh()
 {
-  gif_compressor->compress(image, ColorTable::get_table());
-
-  gif = gif_compressor->get_gif_data();
-  gif_length = gif_compressor->get_gif_length();
-
+  // The encoder thread compresses it and the network thread sends it.
+  publish_frame();
   pause();
 
   return true;
@@ -96,249 +206,1311 @@ bool TelevisionHttp::refresh()
 
 int TelevisionHttp::handle_events()
 {
-  if (net_has_data())
+  return get_event();
+}
+
+void TelevisionHttp::set_base_path(const char *path)
+{
+  strncpy(base_path, path, sizeof(base_path) - 1);
+  base_path[sizeof(base_path) - 1] = 0;
+}
+
+void TelevisionHttp::set_socket_path(const char *path)
+{
+  const char *name = strrchr(path, '/');
+  int length;
+
+  name = name == nullptr ? path : name + 1;
+  length = strlen(name);
+
+  if (length > 5 && strcmp(name + length - 5, ".sock") == 0) { length -= 5; }
+
+  strncpy(handoff_path, path, sizeof(handoff_path) - 1);
+  handoff_path[sizeof(handoff_path) - 1] = 0;
+
+  snprintf(base_path, sizeof(base_path), "/%.*s", length, name);
+}
+
+int TelevisionHttp::add_client(int fd, const uint8_t *data, int length)
+{
+  // Takes a connection from the SessionServer along with what it
+  // already read of the first request.
+  std::lock_guard<std::mutex> guard(lock);
+
+  return adopt_connection(fd, data, length);
+}
+
+int TelevisionHttp::adopt_connection(int fd, const uint8_t *data, int length)
+{
+  // Adds a connection where some of the first request may have already
+  // been read by someone else.
+  Connection *connection = add_connection(fd);
+
+  if (connection == nullptr) { return -1; }
+
+  if (length > (int)sizeof(connection->input))
+  {
+    remove_connection(*connection);
+    return -1;
+  }
+
+  memcpy(connection->input, data, length);
+  connection->input_length = length;
+
+  if (parse_input(*connection) < 0 || read_connection(*connection) < 0)
+  {
+    remove_connection(*connection);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &last_active);
+
+  return 0;
+}
+
+void TelevisionHttp::service_network()
+{
+  // The sockets are edge triggered, so everything that's ready has to
+  // be taken before the server waits again. A short batch doesn't mean
+  // that's all of it, since net_wait() leaves out the wake up pipe.
+  while (true)
   {
-    read_http();
+    const int count = poll_network(0);
 
-    // The query string from the browser is ?keys#timestamp.
-    // The timestamp is unfortunate since it seems the browser is ignoring
-    // the cache expire headers.
-    int n = 0;
+    if (count < 0) { quit = true; }
+    if (count <= 0) { break; }
+  }
+}
+
+void TelevisionHttp::encode_frame(const uint8_t *image)
+{
+  // What the connections need is worked out with the lock held, but the
+  // compressing is done without it so the network thread isn't kept
+  // waiting. Then the buffers are queued with the lock held again.
+  bool need_delta[BROADCAST_COUNT] = { };
+  bool need_whole[BROADCAST_COUNT] = { };
+  OutputQueue::Buffer deltas[BROADCAST_COUNT];
+  OutputQueue::Buffer wholes[BROADCAST_COUNT];
+  OutputQueue::Buffer images[MAX_CONNECTIONS];
+  int image_sequences[MAX_CONNECTIONS];
+  int image_count = 0;
 
-    while (query_string[n] != 0)
+  {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // /image.gif and /frame.gif are compressed from this copy when the
+    // browser asks for them.
+    if (hash_frame(image))
     {
-      if (query_string[n] == '#') { break; }
-      key_queue.append(query_string[n]);
-      n++;
+      memcpy(next_frame, image, width * height);
+      frame_sequence++;
+
+      const int slot = frame_sequence % HISTORY_FRAMES;
+
+      memcpy(history[slot], image, width * height);
+      history_sequence[slot] = frame_sequence;
+
+      snprintf(etag, sizeof(etag), "\"%016llx\"",
+        (unsigned long long)frame_hash);
     }
 
-    if (strcmp(filename, "/") == 0)
+    // Browsers don't show GIF frames faster than every 20ms, so streams
+    // get every other frame or they would fall further and further behind.
+    refresh_count++;
+
+    for (int n = 0; n < BROADCAST_COUNT; n++)
     {
-      send_index_html();
+      broadcasts[n].sent = false;
+      broadcasts[n].delta.reset();
     }
-      else
-    if (strcmp(filename, "/image.gif") == 0)
+
+    for (int n = 0; n < MAX_CONNECTIONS; n++)
+    {
+      Connection &connection = connections[n];
+
+      if (connection.type == CONNECTION_WAITING)
+      {
+        if (!has_next_image(connection)) { continue; }
+
+        int i;
+
+        for (i = 0; i < image_count; i++)
+        {
+          if (image_sequences[i] == connection.sequence) { break; }
+        }
+
+        if (i == image_count)
+        {
+          image_sequences[image_count++] = connection.sequence;
+        }
+
+        continue;
+      }
+
+      if (!wants_frame(connection)) { continue; }
+
+      const int kind = get_broadcast(connection);
+
+      // One that's backed up has its frames dropped and gets it whole.
+      if (!connection.synced || connection.hash != broadcasts[kind].hash ||
+          is_backed_up(connection))
+      {
+        if (broadcasts[kind].whole == nullptr ||
+            broadcasts[kind].whole_hash != frame_hash)
+        {
+          need_whole[kind] = true;
+        }
+      }
+        else
+      {
+        need_delta[kind] = true;
+      }
+    }
+  }
+
+  for (int n = 0; n < BROADCAST_COUNT; n++)
+  {
+    if (need_delta[n])
     {
-      send_gif();
+      deltas[n] =
+        compress_frame(n, broadcasts[n].frame, encoder_gif, encoder_rle);
     }
-      else
+
+    if (need_whole[n])
     {
-      send_404();
+      wholes[n] = compress_frame(n, nullptr, encoder_gif, encoder_rle);
     }
+  }
 
-    filename[0] = 0;
-    query_string[0] = 0;
-    no_data_count = 0;
+  for (int i = 0; i < image_count; i++)
+  {
+    images[i] = compress_image(image_sequences[i], encoder_gif);
   }
-    else
+
   {
-    no_data_count++;
+    std::lock_guard<std::mutex> guard(lock);
+
+    // The network thread may have compressed some of these already for
+    // a connection that came in meanwhile.
+    for (int n = 0; n < BROADCAST_COUNT; n++)
+    {
+      Broadcast &broadcast = broadcasts[n];
+
+      if (deltas[n] != nullptr && broadcast.delta == nullptr)
+      {
+        broadcast.delta = deltas[n];
+      }
+
+      if (wholes[n] != nullptr)
+      {
+        broadcast.whole = wholes[n];
+        broadcast.whole_hash = frame_hash;
+      }
+    }
+
+    for (int n = 0; n < MAX_CONNECTIONS; n++)
+    {
+      Connection &connection = connections[n];
+      int result = 0;
+
+      if (connection.type == CONNECTION_WAITING)
+      {
+        if (has_next_image(connection))
+        {
+          for (int i = 0; i < image_count; i++)
+          {
+            if (image_sequences[i] != connection.sequence) { continue; }
+
+            image_delta = images[i];
+            image_from = connection.sequence;
+            image_to = frame_sequence;
+            break;
+          }
+
+          result = send_next_image(connection);
+        }
+
+        if (result < 0) { remove_connection(connection); }
+        continue;
+      }
+
+      if (wants_frame(connection)) { result = send_frame(connection); }
+
+      if (result < 0) { remove_connection(connection); }
+    }
+
+    // The next deltas are from this frame for the kinds that sent it.
+    for (int n = 0; n < BROADCAST_COUNT; n++)
+    {
+      Broadcast &broadcast = broadcasts[n];
+
+      if (!broadcast.sent) { continue; }
 
-    // If there aren't any web requests for a while, assume the connection
-    // is broken.
-    if (no_data_count == 30 * 60) { return KEY_QUIT; }
+      memcpy(broadcast.frame, next_frame, width * height);
+      broadcast.hash = frame_hash;
+      broadcast.delta.reset();
+    }
   }
 
-  if (!net_is_connected()) { return KEY_QUIT; }
+  net_wake();
+}
 
-  if (!key_queue.is_empty())
+void TelevisionHttp::run_network()
+{
+  while (running)
   {
-    char c = key_queue.get_next();
-    switch (c)
+    if (!net_is_connected() || poll_network(100) < 0)
     {
-      case 's': return KEY_DOWN_DOWN;
-      case 'w': return KEY_UP_DOWN;
-      case 'a': return KEY_LEFT_DOWN;
-      case 'd': return KEY_RIGHT_DOWN;
-      case 'f': return KEY_FIRE_DOWN;
-      case 'e': return KEY_RESET_DOWN;
-      case 'c': return KEY_SELECT_DOWN;
-      case 'S': return KEY_DOWN_UP;
-      case 'W': return KEY_UP_UP;
-      case 'A': return KEY_LEFT_UP;
-      case 'D': return KEY_RIGHT_UP;
-      case 'F': return KEY_FIRE_UP;
-      case 'E': return KEY_RESET_UP;
-      case 'C': return KEY_SELECT_UP;
+      quit = true;
+      break;
     }
   }
-
-  return 0;
 }
 
-int TelevisionHttp::read_http()
+int TelevisionHttp::poll_network(int ms)
 {
-  uint8_t buffer[8192];
-  char line[1024];
-  int ptr = 0, length;
-  bool end_of_headers = false;
+  // Returns the number of sockets that were ready or -1 on error.
+  struct epoll_event ready[MAX_CONNECTIONS + 2];
+
+  const int count = net_wait(ready, MAX_CONNECTIONS + 2, ms);
+
+  if (count < 0) { return -1; }
 
-  while (!end_of_headers)
+  std::lock_guard<std::mutex> guard(lock);
+  bool active = false;
+
+  for (int n = 0; n < count; n++)
   {
-    length = net_recv(buffer, sizeof(buffer), false);
+    const int fd = ready[n].data.fd;
 
-    if (length <= 0 || length == 8192)
+    if (fd == socket_id)
     {
-      printf("Network receive error (return value %d).\n", length);
-      return -1;
+      int client_fd;
+
+      while ((client_fd = net_accept()) != -1)
+      {
+        adopt_connection(client_fd, handoff_data, handoff_length);
+      }
+
+      continue;
     }
 
-    for (int n = 0; n < length; n++)
+    Connection *connection = find_connection(fd);
+
+    if (connection == nullptr) { continue; }
+
+    if ((ready[n].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) == 0)
     {
-      if (buffer[n] == '\r') { continue; }
-      if (buffer[n] == '\n')
-      {
-        line[ptr] = 0;
-        ptr = 0;
+      continue;
+    }
 
-        if (line[0] == 0) { end_of_headers = true; }
+    const int requests = read_connection(*connection);
 
-        if (strncmp(line, "GET /", 5) == 0)
-        {
-//printf("line=%s\n", line);
-          int ptr = 4;
-          uint32_t n = 0;
+    if (requests < 0)
+    {
+      remove_connection(*connection);
+      continue;
+    }
 
-          while (line[ptr] != 0)
-          {
-            if (line[ptr] == ' ') { break; }
-            if (line[ptr] == '?') { break; }
+    if (requests > 0) { active = true; }
+  }
 
-            filename[n++] = line[ptr++];
-            if (n >= sizeof(filename) - 1) { break; }
-          }
+  // encode_frame() queues frames without an EPOLLOUT coming, so every
+  // connection with something waiting gets a try.
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    Connection &connection = connections[n];
 
-          filename[n] = 0;
-          n = 0;
+    if (connection.fd == -1) { continue; }
 
-          if (line[ptr++] == '?')
-          {
-            while (line[ptr] != 0)
-            {
-              if (line[ptr] == ' ') { break; }
+    // An open stream counts as activity. It doesn't send requests, but
+    // reading from it is how the browser closing it is seen.
+    if (connection.type != CONNECTION_HTTP) { active = true; }
 
-              query_string[n++] = line[ptr++];
-              if (n >= sizeof(query_string) - 1) { break; }
-            }
-          }
+    if (net_flush(connection.fd, connection.output) < 0)
+    {
+      remove_connection(connection);
+    }
+  }
 
-          query_string[n] = 0;
-        }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-        continue;
-      }
+  // If there aren't any web requests for a while, assume the
+  // connection is broken.
+  if (active)
+  {
+    last_active = now;
+  }
+    else
+  if (now.tv_sec - last_active.tv_sec >= IDLE_SECONDS)
+  {
+    quit = true;
+  }
+
+  return count;
+}
 
-      line[ptr++] = buffer[n];
+TelevisionHttp::Connection *TelevisionHttp::add_connection(int fd)
+{
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    if (connections[n].fd == -1)
+    {
+      connections[n].fd = fd;
+      connections[n].type = CONNECTION_HTTP;
+      connections[n].spectator = false;
+      connections[n].input_length = 0;
+      connections[n].output.clear();
 
-      if (ptr == sizeof(line) - 1)
+      if (net_watch(fd) != 0)
       {
-        printf("Error: Http line too long (%d).\n", length);
-        return -1;
+        remove_connection(connections[n]);
+        return nullptr;
       }
+
+      return &connections[n];
     }
   }
 
-  return 0;
+  printf("Too many connections.\n");
+  net_disconnect(fd);
+
+  return nullptr;
 }
 
-int TelevisionHttp::send_index_html()
+void TelevisionHttp::remove_connection(Connection &connection)
 {
-  std::string header;
-  const char *page =
-    "<html>\n<body onload='init();' bgcolor='#000000'>\n"
-    "<script type='text/javascript'>\n"
-    "var queue = '';\n"
-    "function init()\n"
-    "{\n"
-      "setTimeout(refresh_image, 2000);\n"
-      "window.addEventListener('keydown', function(event)\n"
-      "{\n"
-        "if (event.defaultPrevented) { return; }\n"
-        "switch(event.keyCode)\n"
-        "{\n"
-          "case 40: queue += 's'; break;\n"
-          "case 38: queue += 'w'; break;\n"
-          "case 37: queue += 'a'; break;\n"
-          "case 39: queue += 'd'; break;\n"
-          "case 32: queue += 'f'; break;\n"
-          "case 13: queue += 'e'; break;\n"
-          "case 67: queue += 'c'; break;\n"
-          "default: break;\n"
-        "}\n"
-      "});\n"
-      "window.addEventListener('keyup', function(event)\n"
-      "{\n"
-        "if (event.defaultPrevented) { return; }\n"
-        "switch(event.keyCode)\n"
-        "{\n"
-          "case 40: queue += 'S'; break;\n"
-          "case 38: queue += 'W'; break;\n"
-          "case 37: queue += 'A'; break;\n"
-          "case 39: queue += 'D'; break;\n"
-          "case 32: queue += 'F'; break;\n"
-          "case 13: queue += 'E'; break;\n"
-          "case 67: queue += 'C'; break;\n"
-          "default: break;\n"
-        "}\n"
-      "});\n"
-    "}\n"
-    "function refresh_image()\n"
-    "{\n"
-    //"console.log('refresh_image()');\n"
-    "var atari = document.getElementById('atari');\n"
-    "if (atari.complete)\n"
-    "{\n"
-    "atari.src = 'image.gif?' + queue + '#' + new Date().getTime();\n"
-    "queue = '';\n"
-    "}\n"
-    "setTimeout(refresh_image, 33);\n"
-    "}\n"
-    "</script>\n"
-    "<table width=100%% height=100%%>"
-    "<tr><td width=100%% height=100%% align='center'>"
-    "<img src='image.gif' id='atari'></td></tr>"
-    "</body>\n</html>\n\n";
+  // Anything still waiting, like the reply to a WebSocket close, gets
+  // one chance to go out.
+  net_flush(connection.fd, connection.output);
+  net_disconnect(connection.fd);
 
-  header =
-    "HTTP/1.1 200 OK\n"
-    "Cache-Control: no-cache, must-revalidate\n"
-    "Pragma: no-cache\n"
-    "Content-Type: text/html\n"
-    "Content-Length: " + std::to_string(strlen(page)) + "\n\n";
+  // Let go of any keys the player was holding down.
+  if (connection.type == CONNECTION_WEBSOCKET && !connection.spectator)
+  {
+    set_input_state(0);
+  }
 
-  net_send((uint8_t *)header.c_str(), header.size());
-  net_send((uint8_t *)page, strlen(page));
+  connection.fd = -1;
+  connection.type = CONNECTION_HTTP;
+  connection.gif = false;
+  connection.spectator = false;
+  connection.hash = 0;
+  connection.synced = false;
+  connection.sequence = 0;
+  connection.input_length = 0;
+  connection.output.clear();
+}
 
-  return 0;
+TelevisionHttp::Connection *TelevisionHttp::find_connection(int fd)
+{
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    if (connections[n].fd == fd) { return &connections[n]; }
+  }
+
+  return nullptr;
 }
 
-int TelevisionHttp::send_gif()
+bool TelevisionHttp::has_player()
 {
-  std::string header =
-    "HTTP/1.1 200 OK\n"
-    "Content-Type: image/gif\n"
-    "Cache-Control: no-cache, must-revalidate\n"
-    "Pragma: no-cache\n"
-    "Content-Length: " + std::to_string(gif_length) + "\n\n";
+  for (int n = 0; n < MAX_CONNECTIONS; n++)
+  {
+    const Connection &connection = connections[n];
 
-  net_send((uint8_t *)header.c_str(), header.size());
-  net_send(gif, gif_length);
+    if (connection.type == CONNECTION_WEBSOCKET && !connection.spectator)
+    {
+      return true;
+    }
+  }
 
-  return 0;
+  return false;
 }
 
-int TelevisionHttp::send_404()
+int TelevisionHttp::read_connection(Connection &connection)
 {
-  const char *page = "<p>Not found</p>";
+  int requests = 0;
 
-  std::string header =
-    "HTTP/1.1 404 Not Found\n"
-    "Content-Type: text/html\n"
-    "Content-Length: " + std::to_string(strlen(page)) + "\n\n";
+  // The socket is edge triggered, so read until there's nothing left.
+  while (true)
+  {
+    const int space = sizeof(connection.input) - connection.input_length;
 
-  net_send((uint8_t *)header.c_str(), header.size());
-  net_send((uint8_t *)page, strlen(page));
+    if (space == 0)
+    {
+      printf("Error: Http request too long.\n");
+      return -1;
+    }
 
-  return 0;
+    int length = net_recv_some(
+      connection.fd,
+      connection.input + connection.input_length,
+      space);
+
+    if (length < 0) { return -1; }
+    if (length == 0) { break; }
+
+    connection.input_length += length;
+
+    const int count = parse_input(connection);
+
+    if (count < 0) { return -1; }
+
+    requests += count;
+  }
+
+  return requests;
+}
+
+int TelevisionHttp::parse_input(Connection &connection)
+{
+  // Handles each whole request or WebSocket message in the input and
+  // returns the number of requests.
+  int requests = 0;
+  int ptr = 0;
+
+  while (ptr < connection.input_length)
+  {
+    const uint8_t *data = connection.input + ptr;
+    const int remaining = connection.input_length - ptr;
+    int count;
+
+    if (connection.type == CONNECTION_WEBSOCKET)
+    {
+      count = read_websocket(connection, data, remaining);
+    }
+      else
+    {
+      count = parse_http(data, remaining);
+
+      if (count > 0 && filename[0] != 0)
+      {
+        requests++;
+
+        if (handle_request(connection) < 0) { return -1; }
+      }
+    }
+
+    if (count < 0) { return -1; }
+    if (count == 0) { break; }
+
+    ptr += count;
+  }
+
+  connection.input_length -= ptr;
+  memmove(connection.input, connection.input + ptr, connection.input_length);
+
+  return requests;
+}
+
+int TelevisionHttp::handle_request(Connection &connection)
+{
+  // The query string from the browser is ?keys&timestamp.
+  // The timestamp is unfortunate since it seems the browser is ignoring
+  // the cache expire headers. A spectator's WebSocket is ?watch.
+  const bool watch = strcmp(query_string, "watch") == 0;
+  const bool keys = !watch && !has_player();
+  int n = 0;
+
+  while (query_string[n] != 0)
+  {
+    if (query_string[n] == '#' || query_string[n] == '&') { break; }
+    if (keys) { add_key(query_string[n]); }
+    n++;
+  }
+
+  const int sequence = query_string[n] == '&' ? atoi(query_string + n + 1) : 0;
+
+  // Hosted or behind a FrontDoor, its pages are under its base path.
+  const int base_length = strlen(base_path);
+
+  if (base_length != 0 && strncmp(filename, base_path, base_length) == 0)
+  {
+    const int length = strlen(filename) - base_length;
+
+    memmove(filename, filename + base_length, length + 1);
+  }
+
+  if (strcmp(filename, "/") == 0)
+  {
+    send_index_html(connection);
+  }
+    else
+  if ((strcmp(filename, "/socket") == 0 ||
+       strcmp(filename, "/socket.gif") == 0) && websocket_key[0] != 0)
+  {
+    connection.gif = strcmp(filename, "/socket.gif") == 0;
+    connection.spectator = watch || has_player();
+
+    if (send_websocket_accept(connection) < 0) { return -1; }
+  }
+    else
+  if (strcmp(filename, "/keys") == 0)
+  {
+    send_no_content(connection);
+  }
+    else
+  if (strcmp(filename, "/stream.gif") == 0)
+  {
+    if (send_stream(connection) < 0) { return -1; }
+  }
+    else
+  if (strcmp(filename, "/image.gif") == 0)
+  {
+    // Answered in encode_frame() when there is a new frame.
+    connection.type = CONNECTION_WAITING;
+    connection.sequence = sequence;
+
+    if (has_next_image(connection) && send_next_image(connection) < 0)
+    {
+      return -1;
+    }
+  }
+    else
+  if (strcmp(filename, "/frame.gif") == 0)
+  {
+    send_gif(connection);
+  }
+    else
+  {
+    send_404(connection);
+  }
+
+  filename[0] = 0;
+  query_string[0] = 0;
+
+  return 0;
+}
+
+int TelevisionHttp::parse_http(const uint8_t *data, int length)
+{
+  // Returns the length of the request up to the blank line after the
+  // headers, or 0 if that hasn't all come in yet. It starts over from
+  // the beginning each time more comes in.
+  char line[1024];
+  int ptr = 0;
+
+  filename[0] = 0;
+  query_string[0] = 0;
+  websocket_key[0] = 0;
+  if_none_match[0] = 0;
+
+  for (int n = 0; n < length; n++)
+  {
+    if (data[n] == '\r') { continue; }
+    if (data[n] == '\n')
+    {
+      line[ptr] = 0;
+      ptr = 0;
+
+      if (line[0] == 0) { return n + 1; }
+
+      if (strncasecmp(line, "Sec-WebSocket-Key:", 18) == 0)
+      {
+        const char *key = line + 18;
+
+        while (*key == ' ') { key++; }
+
+        strncpy(websocket_key, key, sizeof(websocket_key) - 1);
+        websocket_key[sizeof(websocket_key) - 1] = 0;
+      }
+
+      if (strncasecmp(line, "If-None-Match:", 14) == 0)
+      {
+        const char *value = line + 14;
+
+        while (*value == ' ') { value++; }
+
+        strncpy(if_none_match, value, sizeof(if_none_match) - 1);
+        if_none_match[sizeof(if_none_match) - 1] = 0;
+      }
+
+      if (strncmp(line, "GET /", 5) == 0)
+      {
+//printf("line=%s\n", line);
+        int ptr = 4;
+        uint32_t n = 0;
+
+        while (line[ptr] != 0)
+        {
+          if (line[ptr] == ' ') { break; }
+          if (line[ptr] == '?') { break; }
+
+          filename[n++] = line[ptr++];
+          if (n >= sizeof(filename) - 1) { break; }
+        }
+
+        filename[n] = 0;
+        n = 0;
+
+        if (line[ptr++] == '?')
+        {
+          while (line[ptr] != 0)
+          {
+            if (line[ptr] == ' ') { break; }
+
+            query_string[n++] = line[ptr++];
+            if (n >= sizeof(query_string) - 1) { break; }
+          }
+        }
+
+        query_string[n] = 0;
+      }
+
+      continue;
+    }
+
+    line[ptr++] = data[n];
+
+    if (ptr == sizeof(line) - 1)
+    {
+      printf("Error: Http line too long (%d).\n", length);
+      return -1;
+    }
+  }
+
+  // Not all of the headers are here yet.
+  return 0;
+}
+
+int TelevisionHttp::send_index_html(Connection &connection)
+{
+  std::string header;
+  const char *page =
+    "<html>\n<body onload='init();' bgcolor='#000000'>\n"
+    "<script type='text/javascript'>\n"
+    "var state = 0;\n"
+    "var socket;\n"
+    "var context;\n"
+    "var pixels;\n"
+    "var view;\n"
+    "var colors = new Uint32Array(128);\n"
+    "var gif = location.hash == '#gif';\n"
+    "var poll = location.hash == '#poll' || !window.WebSocket;\n"
+    "var watch = location.hash == '#watch';\n"
+    "var last_frame = 0;\n"
+    "var pending = {};\n"
+    "var image;\n"
+    "var frames = [];\n"
+    "var drawing = false;\n"
+    "function init()\n"
+    "{\n"
+      "context = document.getElementById('atari').getContext('2d');\n"
+      "pixels = context.createImageData(160, 192);\n"
+      "view = new Uint32Array(pixels.data.buffer);\n"
+      "image = new Image();\n"
+      "image.onload = function()\n"
+      "{\n"
+        "context.drawImage(image, 0, 0);\n"
+        "URL.revokeObjectURL(image.src);\n"
+        "drawing = false;\n"
+        "draw_frame();\n"
+      "};\n"
+      "window.addEventListener('keydown', function(event)\n"
+      "{\n"
+        "set_key(event, true);\n"
+      "});\n"
+      "window.addEventListener('keyup', function(event)\n"
+      "{\n"
+        "set_key(event, false);\n"
+      "});\n"
+      "if (poll) { start_poll(); return; }\n"
+      "var protocol = location.protocol == 'https:' ? 'wss://' : 'ws://';\n"
+      "var path = location.pathname.replace(/[^\\/]*$/, '') + "
+        "(gif ? 'socket.gif' : 'socket') + (watch ? '?watch' : '');\n"
+      "socket = new WebSocket(protocol + location.host + path);\n"
+      "socket.binaryType = 'arraybuffer';\n"
+      "socket.onmessage = function(event)\n"
+      "{\n"
+        "if (!gif) { decode(new Uint8Array(event.data)); return; }\n"
+        "frames.push(event.data);\n"
+        "draw_frame();\n"
+      "};\n"
+    "}\n"
+    // Without a WebSocket the page starts with the whole frame and then
+    // keeps an /image.gif request waiting for the next one.
+    "function start_poll()\n"
+    "{\n"
+    "var request = new XMLHttpRequest();\n"
+    "request.open('GET', 'frame.gif?&' + Date.now(), true);\n"
+    "request.responseType = 'blob';\n"
+    "request.onload = function()\n"
+    "{\n"
+      "last_frame = request.getResponseHeader('X-Frame');\n"
+      "frames.push(request.response);\n"
+      "draw_frame();\n"
+      "poll_frame();\n"
+    "};\n"
+    "request.send();\n"
+    "}\n"
+    // The GIFs only have what changed since the one before, so if they
+    // come back out of order they wait in pending until they're next.
+    "function poll_frame()\n"
+    "{\n"
+    "var request = new XMLHttpRequest();\n"
+    "request.open('GET', 'image.gif?&' + last_frame, true);\n"
+    "request.responseType = 'blob';\n"
+    "request.onload = function()\n"
+    "{\n"
+      "pending[request.getResponseHeader('X-Previous-Frame')] =\n"
+        "{ frame: request.getResponseHeader('X-Frame'), "
+          "data: request.response };\n"
+      "while (pending[last_frame] !== undefined)\n"
+      "{\n"
+        "var next = pending[last_frame];\n"
+        "delete pending[last_frame];\n"
+        "frames.push(next.data);\n"
+        "last_frame = next.frame;\n"
+      "}\n"
+      "draw_frame();\n"
+      "poll_frame();\n"
+    "};\n"
+    "request.onerror = function() { setTimeout(poll_frame, 1000); };\n"
+    "request.send();\n"
+    "}\n"
+    // See RleCompressor.h for the format. The canvas is RGBA in memory
+    // so the colors are stored as ABGR in the little endian view.
+    "function decode(data)\n"
+    "{\n"
+    "var ptr = 1;\n"
+    "if (data[0] == 80)\n"
+    "{\n"
+      "for (var n = 0; n < 128; n++, ptr += 3)\n"
+      "{\n"
+        "colors[n] = 0xff000000 | (data[ptr + 2] << 16) | "
+          "(data[ptr + 1] << 8) | data[ptr];\n"
+      "}\n"
+      "return;\n"
+    "}\n"
+    "var pixel = 0;\n"
+    "while (ptr < data.length)\n"
+    "{\n"
+      "var code = data[ptr++];\n"
+      "if (code < 0x80)\n"
+      "{\n"
+        "var color = colors[code];\n"
+        "var end = pixel + data[ptr++] + 1;\n"
+        "while (pixel < end) { view[pixel++] = color; }\n"
+      "}\n"
+      "else if (code < 0xc0) { pixel += (code & 0x3f) + 1; }\n"
+      "else { pixel += ((code & 0x3f) + 1) * 160; }\n"
+    "}\n"
+    "context.putImageData(pixels, 0, 0);\n"
+    "}\n"
+    // The GIFs only have the pixels that changed so they have to be
+    // drawn one at a time in order.
+    "function draw_frame()\n"
+    "{\n"
+    "if (drawing || frames.length == 0) { return; }\n"
+    "drawing = true;\n"
+    "var blob = new Blob([ frames.shift() ], { type: 'image/gif' });\n"
+    "image.src = URL.createObjectURL(blob);\n"
+    "}\n"
+    "function set_key(event, down)\n"
+    "{\n"
+    "if (watch || event.defaultPrevented) { return; }\n"
+    "var n;\n"
+    "switch(event.keyCode)\n"
+    "{\n"
+      "case 38: n = 0; break;\n"
+      "case 40: n = 1; break;\n"
+      "case 37: n = 2; break;\n"
+      "case 39: n = 3; break;\n"
+      "case 32: n = 4; break;\n"
+      "case 13: n = 5; break;\n"
+      "case 67: n = 6; break;\n"
+      "default: return;\n"
+    "}\n"
+    "var bit = 1 << n;\n"
+    "var next = down ? (state | bit) : (state & ~bit);\n"
+    "if (next == state) { return; }\n"
+    "state = next;\n"
+    "if (!poll)\n"
+    "{\n"
+      "if (socket.readyState == 1)\n"
+      "{\n"
+        "socket.send(new Uint8Array([ state ]));\n"
+      "}\n"
+      "return;\n"
+    "}\n"
+    "var key = (down ? 'wsadfec' : 'WSADFEC').charAt(n);\n"
+    "var request = new XMLHttpRequest();\n"
+    "request.open('GET', 'keys?' + key + '&' + Date.now(), true);\n"
+    "request.send();\n"
+    "}\n"
+    "</script>\n"
+    "<table width=100%% height=100%%>"
+    "<tr><td width=100%% height=100%% align='center'>"
+    "<canvas id='atari' width=160 height=192 "
+    "style='width: 480px; height: 384px; "
+    "image-rendering: pixelated; image-rendering: crisp-edges;'>"
+    "</canvas>"
+    "</td></tr>"
+    "</body>\n</html>\n\n";
+
+  header =
+    "HTTP/1.1 200 OK\n"
+    "Cache-Control: no-cache, must-revalidate\n"
+    "Pragma: no-cache\n"
+    "Content-Type: text/html\n"
+    "Content-Length: " + std::to_string(strlen(page)) + "\n\n";
+
+  queue_send(connection, (uint8_t *)header.c_str(), header.size());
+  queue_send(connection, (uint8_t *)page, strlen(page));
+
+  return 0;
+}
+
+int TelevisionHttp::send_gif(Connection &connection)
+{
+  if (if_none_match[0] != 0 && strcmp(if_none_match, etag) == 0)
+  {
+    return send_not_modified(connection);
+  }
+
+  if (frame_gif == nullptr || frame_gif_hash != frame_hash)
+  {
+    gif_compressor->compress(next_frame, ColorTable::get_table());
+
+    frame_gif_length = gif_compressor->get_gif_length();
+    frame_gif = (uint8_t *)realloc(frame_gif, frame_gif_length);
+    frame_gif_hash = frame_hash;
+
+    memcpy(frame_gif, gif_compressor->get_gif_data(), frame_gif_length);
+  }
+
+  std::string header =
+    "HTTP/1.1 200 OK\n"
+    "Content-Type: image/gif\n"
+    "Cache-Control: no-cache, must-revalidate\n"
+    "Pragma: no-cache\n"
+    "ETag: " + std::string(etag) + "\n"
+    "X-Frame: " + std::to_string(frame_sequence) + "\n"
+    "Content-Length: " + std::to_string(frame_gif_length) + "\n\n";
+
+  queue_send(connection, (uint8_t *)header.c_str(), header.size());
+  queue_send(connection, frame_gif, frame_gif_length);
+
+  return 0;
+}
+
+bool TelevisionHttp::has_next_image(Connection &connection)
+{
+  return frame_sequence > connection.sequence;
+}
+
+int TelevisionHttp::send_next_image(Connection &connection)
+{
+  // Every request from the same frame gets the same GIF, so it's only
+  // compressed again when the frames it goes between change.
+  if (image_delta == nullptr ||
+      image_from != connection.sequence ||
+      image_to != frame_sequence)
+  {
+    image_delta = compress_image(connection.sequence, gif_compressor);
+    image_from = connection.sequence;
+    image_to = frame_sequence;
+  }
+
+  connection.type = CONNECTION_HTTP;
+  connection.output.push(image_delta);
+
+  return 0;
+}
+
+OutputQueue::Buffer TelevisionHttp::compress_image(
+  int from,
+  GifCompressor *gif)
+{
+  uint8_t *last_frame = find_history(from);
+
+  // Without the frame the browser has, it gets the whole frame.
+  if (last_frame != nullptr)
+  {
+    gif->compress_delta(next_frame, last_frame, ColorTable::get_table());
+  }
+    else
+  {
+    gif->compress(next_frame, ColorTable::get_table());
+  }
+
+  const int length = gif->get_gif_length();
+
+  std::string header =
+    "HTTP/1.1 200 OK\n"
+    "Content-Type: image/gif\n"
+    "Cache-Control: no-store\n"
+    "Pragma: no-cache\n"
+    "X-Frame: " + std::to_string(frame_sequence) + "\n"
+    "X-Previous-Frame: " + std::to_string(from) + "\n"
+    "Content-Length: " + std::to_string(length) + "\n\n";
+
+  return OutputQueue::make_buffer(
+    (const uint8_t *)header.c_str(),
+    header.size(),
+    gif->get_gif_data(),
+    length);
+}
+
+uint8_t *TelevisionHttp::find_history(int sequence)
+{
+  if (sequence < 0) { return nullptr; }
+
+  const int slot = sequence % HISTORY_FRAMES;
+
+  if (history_sequence[slot] != sequence) { return nullptr; }
+
+  return history[slot];
+}
+
+int TelevisionHttp::send_stream(Connection &connection)
+{
+  // No Content-Length since the GIF doesn't end. The browser shows each
+  // frame as it comes in.
+  std::string header =
+    "HTTP/1.1 200 OK\n"
+    "Content-Type: image/gif\n"
+    "Cache-Control: no-cache, must-revalidate\n"
+    "Pragma: no-cache\n"
+    "Connection: close\n\n";
+
+  if (queue_send(connection, (uint8_t *)header.c_str(), header.size()) < 0)
+  {
+    return -1;
+  }
+
+  gif_compressor->stream_header();
+
+  int n = queue_send(
+    connection,
+    gif_compressor->get_gif_data(),
+    gif_compressor->get_gif_length());
+
+  if (n < 0) { return -1; }
+
+  connection.type = CONNECTION_STREAM;
+
+  return send_frame(connection);
+}
+
+int TelevisionHttp::send_frame(Connection &connection)
+{
+  if (!drop_frames(connection)) { return 0; }
+
+  const int kind = get_broadcast(connection);
+
+  // A browser that has the last frame of its kind gets what changed
+  // since then, the others get the whole frame. Either way it's the
+  // same buffer for all of them.
+  const bool whole =
+    !connection.synced || connection.hash != broadcasts[kind].hash;
+
+  connection.output.push(get_frame_data(kind, whole), true);
+  connection.hash = frame_hash;
+  connection.synced = true;
+
+  broadcasts[kind].sent = true;
+
+  return 0;
+}
+
+bool TelevisionHttp::wants_frame(Connection &connection)
+{
+  // The browser is already showing this frame.
+  if (connection.synced && connection.hash == frame_hash) { return false; }
+
+  return connection.type == CONNECTION_WEBSOCKET ||
+        (connection.type == CONNECTION_STREAM && (refresh_count & 1) == 0);
+}
+
+int TelevisionHttp::get_broadcast(Connection &connection)
+{
+  if (connection.type == CONNECTION_STREAM) { return BROADCAST_STREAM; }
+
+  return connection.gif ? BROADCAST_GIF : BROADCAST_RLE;
+}
+
+OutputQueue::Buffer TelevisionHttp::get_frame_data(int kind, bool whole)
+{
+  Broadcast &broadcast = broadcasts[kind];
+
+  if (whole)
+  {
+    if (broadcast.whole == nullptr || broadcast.whole_hash != frame_hash)
+    {
+      broadcast.whole =
+        compress_frame(kind, nullptr, gif_compressor, rle_compressor);
+      broadcast.whole_hash = frame_hash;
+    }
+
+    return broadcast.whole;
+  }
+
+  if (broadcast.delta == nullptr)
+  {
+    broadcast.delta =
+      compress_frame(kind, broadcast.frame, gif_compressor, rle_compressor);
+  }
+
+  return broadcast.delta;
+}
+
+OutputQueue::Buffer TelevisionHttp::compress_frame(
+  int kind,
+  uint8_t *last_frame,
+  GifCompressor *gif,
+  RleCompressor *rle)
+{
+  // Without a last frame it's the whole frame.
+  const uint8_t *data;
+  int length;
+
+  if (kind == BROADCAST_RLE)
+  {
+    rle->compress(next_frame, last_frame);
+    data = rle->get_data();
+    length = rle->get_length();
+  }
+    else
+  {
+    if (kind == BROADCAST_STREAM)
+    {
+      gif->stream_frame(next_frame, last_frame, ColorTable::get_table());
+    }
+      else
+    if (last_frame == nullptr)
+    {
+      gif->compress(next_frame, ColorTable::get_table());
+    }
+      else
+    {
+      gif->compress_delta(next_frame, last_frame, ColorTable::get_table());
+    }
+
+    data = gif->get_gif_data();
+    length = gif->get_gif_length();
+  }
+
+  // A stream is just the GIF, WebSocket messages need a header.
+  uint8_t header[10];
+  int header_length = 0;
+
+  if (kind != BROADCAST_STREAM)
+  {
+    header_length =
+      WebSocket::make_header(header, WebSocket::OPCODE_BINARY, length);
+  }
+
+  return OutputQueue::make_buffer(header, header_length, data, length);
+}
+
+int TelevisionHttp::send_no_content(Connection &connection)
+{
+  const char *header = "HTTP/1.1 204 No Content\n\n";
+
+  queue_send(connection, (const uint8_t *)header, strlen(header));
+
+  return 0;
+}
+
+int TelevisionHttp::send_not_modified(Connection &connection)
+{
+  std::string header =
+    "HTTP/1.1 304 Not Modified\n"
+    "ETag: " + std::string(etag) + "\n\n";
+
+  queue_send(connection, (uint8_t *)header.c_str(), header.size());
+
+  return 0;
+}
+
+int TelevisionHttp::send_websocket_accept(Connection &connection)
+{
+  char accept[32];
+
+  WebSocket::get_accept_key(accept, websocket_key);
+
+  std::string header =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: " + std::string(accept) + "\r\n\r\n";
+
+  if (queue_send(connection, (uint8_t *)header.c_str(), header.size()) < 0)
+  {
+    return -1;
+  }
+
+  connection.type = CONNECTION_WEBSOCKET;
+
+  // The page needs the colors before it can draw the first frame.
+  if (!connection.gif)
+  {
+    rle_compressor->palette(ColorTable::get_table());
+
+    if (send_websocket_message(
+      connection,
+      WebSocket::OPCODE_BINARY,
+      rle_compressor->get_data(),
+      rle_compressor->get_length()) < 0)
+    {
+      return -1;
+    }
+  }
+
+  return send_frame(connection);
+}
+
+int TelevisionHttp::send_websocket_message(
+  Connection &connection,
+  int opcode,
+  const uint8_t *data,
+  int length)
+{
+  uint8_t header[10];
+  const int header_length = WebSocket::make_header(header, opcode, length);
+
+  connection.output.push(header, header_length, data, length, false);
+
+  return 0;
+}
+
+int TelevisionHttp::read_websocket(
+  Connection &connection,
+  const uint8_t *data,
+  int length)
+{
+  uint8_t payload[64];
+  int opcode, payload_length;
+
+  int count = WebSocket::parse(
+    data,
+    length,
+    opcode,
+    payload,
+    payload_length,
+    sizeof(payload));
+
+  if (count <= 0) { return count; }
+
+  switch (opcode)
+  {
+    case WebSocket::OPCODE_BINARY:
+      if (payload_length > 0 && !connection.spectator)
+      {
+        set_input_state(payload[0]);
+      }
+      break;
+    case WebSocket::OPCODE_PING:
+      send_websocket_message(
+        connection,
+        WebSocket::OPCODE_PONG,
+        payload,
+        payload_length);
+      break;
+    case WebSocket::OPCODE_CLOSE:
+      send_websocket_message(
+        connection,
+        WebSocket::OPCODE_CLOSE,
+        payload,
+        payload_length);
+      return -1;
+  }
+
+  return count;
+}
+
+void TelevisionHttp::set_input_state(int state)
+{
+  // Turn each bit that changed into the same key up or down that
+  // /keys?keys would send, in the order of the INPUT_ bits.
+  const char *keys_down = "wsadfec";
+  const char *keys_up = "WSADFEC";
+  const int changed = state ^ input_state;
+
+  for (int n = 0; n < 7; n++)
+  {
+    if ((changed & (1 << n)) == 0) { continue; }
+
+    add_key((state & (1 << n)) != 0 ? keys_down[n] : keys_up[n]);
+  }
+
+  input_state = state;
+}
+
+int TelevisionHttp::send_404(Connection &connection)
+{
+  const char *page = "<p>Not found</p>";
+
+  std::string header =
+    "HTTP/1.1 404 Not Found\n"
+    "Content-Type: text/html\n"
+    "Content-Length: " + std::to_string(strlen(page)) + "\n\n";
+
+  queue_send(connection, (uint8_t *)header.c_str(), header.size());
+  queue_send(connection, (uint8_t *)page, strlen(page));
+
+  return 0;
+}
+
+void TelevisionHttp::add_key(char key)
+{
+  int event;
+
+  switch (key)
+  {
+    case 's': event = KEY_DOWN_DOWN; break;
+    case 'w': event = KEY_UP_DOWN; break;
+    case 'a': event = KEY_LEFT_DOWN; break;
+    case 'd': event = KEY_RIGHT_DOWN; break;
+    case 'f': event = KEY_FIRE_DOWN; break;
+    case 'e': event = KEY_RESET_DOWN; break;
+    case 'c': event = KEY_SELECT_DOWN; break;
+    case 'S': event = KEY_DOWN_UP; break;
+    case 'W': event = KEY_UP_UP; break;
+    case 'A': event = KEY_LEFT_UP; break;
+    case 'D': event = KEY_RIGHT_UP; break;
+    case 'F': event = KEY_FIRE_UP; break;
+    case 'E': event = KEY_RESET_UP; break;
+    case 'C': event = KEY_SELECT_UP; break;
+    default: return;
+  }
+
+  if (!events.push(event))
+  {
+    printf("Input queue full, dropping key.\n");
+  }
+}
+
+int TelevisionHttp::queue_send(
+  Connection &connection,
+  const uint8_t *data,
+  int length)
+{
+  // The network thread sends it when the socket can take it.
+  connection.output.push(data, length);
+
+  return 0;
+}
+
+bool TelevisionHttp::is_backed_up(Connection &connection)
+{
+  return
+    connection.output.get_frames() >= MAX_FRAMES ||
+    connection.output.get_length() > MAX_OUTPUT;
+}
+
+bool TelevisionHttp::drop_frames(Connection &connection)
+{
+  // Returns false if there still isn't room for another frame.
+  if (!is_backed_up(connection)) { return true; }
+
+  // Each frame queued is only what changed since the one before it, so
+  // they all have to go and the next one is sent whole.
+  connection.output.drop_frames();
+  connection.synced = false;
+
+  return !is_backed_up(connection);
 }
 
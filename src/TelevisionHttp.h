@@ -7,12 +7,59 @@
  *
  * Copyright 2021 by Michael Kohn
  *
- * TelevisionHttp implements a small web server that allows only one
- * connection. When a request for / comes in the a web page with some
- * simple Javascript will start requesting GIF images from this server
- * 30 times a second. Keyboard presses are captured and put in a
- * "queue" variable that are transmitted back to the server when new
- * GIF images are requested.
+ * TelevisionHttp implements a small web server for one browser. When a
+ * request for / comes in the a web page is sent that opens a WebSocket
+ * on /socket. The palette is sent on it first and then each time the
+ * TIA finishes a frame the rows that changed are sent as a binary
+ * message (see RleCompressor), which the page draws on a canvas. The
+ * page sends a 1 byte binary message with the state of the joystick
+ * and switches each time a key goes up or down.
+ *
+ * /socket.gif is the same except the frames are GIFs of the pixels that
+ * changed. The page uses it when it's loaded as /#gif.
+ *
+ * Without the WebSocket, /stream.gif is an animated GIF that never ends
+ * with a frame added as each one is drawn and keys can be sent with
+ * /keys?keys requests. /frame.gif is the whole frame and has the frame
+ * hash as an ETag, so a matching If-None-Match gets a 304.
+ *
+ * Each new frame gets a sequence number. /image.gif?keys&sequence waits
+ * until there is a frame newer than that sequence, the one the browser
+ * is showing, then gets the pixels that changed since it. The last few
+ * frames are kept for this, and a browser further behind gets the whole
+ * frame. It's only compressed when a request is waiting for it, and
+ * once for all the requests from the same frame. The X-Frame and
+ * X-Previous-Frame headers say which frames it goes between. The page
+ * uses this when it can't open a WebSocket or when it's loaded as
+ * /#poll.
+ *
+ * Frames that are the same as the last one sent on a stream or
+ * WebSocket aren't sent at all.
+ *
+ * Frames are compressed on the encoder thread and queued on each
+ * connection. The network thread does all of the reading and writing
+ * from an epoll loop and turns requests and WebSocket messages into key
+ * events. If a browser falls MAX_FRAMES behind, the frames it hasn't
+ * started getting are dropped and it gets the next one whole.
+ *
+ * Any number of browsers can watch at once. Stream and WebSocket frames
+ * are compressed once per frame, not once per browser: the browsers that
+ * have the last frame sent share one buffer with what changed and the
+ * rest share one with the whole frame. Polling browsers each get what
+ * changed since their own last frame, shared with any others that had
+ * the same one, so any number of them can watch too. The first /socket
+ * is the player and only its input is used. Later ones, and
+ * /socket?watch from a page loaded as /#watch, are spectators. Keys in
+ * query strings are ignored while there is a player on a WebSocket.
+ *
+ * Hosted by a SessionServer, it doesn't listen on a port. The server
+ * passes it the connections for its pages under set_base_path(), and
+ * calls service_network() when get_network_fd() has something ready.
+ *
+ * With set_socket_path() it takes its connections from a FrontDoor
+ * on that Unix socket instead of a port. The FrontDoor sends it the
+ * requests for /name/, where the socket is name.sock. A ProcessPool
+ * does the same with set_control_socket().
  *
  */
 
@@ -21,9 +68,13 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <mutex>
 
 #include "GifCompressor.h"
 #include "Network.h"
+#include "OutputQueue.h"
+#include "RleCompressor.h"
 #include "Television.h"
 
 class TelevisionHttp : public Television, public Network
@@ -38,53 +89,185 @@ public:
   //virtual void draw_pixel(int x, int y, uint8_t color);
   virtual bool refresh();
   virtual int handle_events();
-  virtual void *get_image() { return image; }
-  virtual int get_bitsize() { return 8; }
   virtual void set_port(int value) { port = value; };
 
+  void set_base_path(const char *path);
+  void set_socket_path(const char *path);
+  void set_control_socket(int fd) { control_fd = fd; }
+  int add_client(int fd, const uint8_t *data, int length);
+  int get_network_fd() { return epoll_fd; }
+  void service_network();
+
+protected:
+  virtual void encode_frame(const uint8_t *image);
+  virtual void run_network();
+
 private:
-  int read_http();
-  int send_index_html();
-  int send_gif();
-  int send_404();
-
-  uint8_t *image;
-  uint8_t *gif;
-  int gif_length;
-  int no_data_count;
+  struct Connection
+  {
+    int fd;
+    int type;
+
+    // WebSocket frames are GIFs instead of RleCompressor frames.
+    bool gif;
+
+    // Input from a spectator's WebSocket is ignored.
+    bool spectator;
+
+    // Hash of the last frame sent on a stream or WebSocket, if synced.
+    // Frames dropped after it leave it not synced.
+    uint64_t hash;
+    bool synced;
+
+    // A waiting /image.gif wants a frame newer than this, with what
+    // changed since it.
+    int sequence;
+
+    // Data that isn't a whole request or WebSocket message yet.
+    uint8_t input[8192];
+    int input_length;
+
+    // Data the network thread hasn't been able to send yet.
+    OutputQueue output;
+  };
+
+  enum
+  {
+    CONNECTION_HTTP,
+    CONNECTION_STREAM,
+    CONNECTION_WEBSOCKET,
+    CONNECTION_WAITING,
+  };
+
+  // The ways a frame is compressed for streams and WebSockets.
+  enum
+  {
+    BROADCAST_RLE,
+    BROADCAST_GIF,
+    BROADCAST_STREAM,
+    BROADCAST_COUNT,
+  };
+
+  // The last frame sent of one kind, and this frame compressed both as
+  // what changed since then and whole. The delta is only good until
+  // the end of encode_frame(), when frame becomes this frame.
+  struct Broadcast
+  {
+    uint8_t *frame;
+    uint64_t hash;
+    bool sent;
+    OutputQueue::Buffer delta;
+    OutputQueue::Buffer whole;
+    uint64_t whole_hash;
+  };
+
+  // Bits in the WebSocket input message.
+  enum
+  {
+    INPUT_UP = 0x01,
+    INPUT_DOWN = 0x02,
+    INPUT_LEFT = 0x04,
+    INPUT_RIGHT = 0x08,
+    INPUT_FIRE = 0x10,
+    INPUT_RESET = 0x20,
+    INPUT_SELECT = 0x40,
+  };
+
+  int poll_network(int ms);
+  Connection *add_connection(int fd);
+  int adopt_connection(int fd, const uint8_t *data, int length);
+  void remove_connection(Connection &connection);
+  Connection *find_connection(int fd);
+  bool has_player();
+  int read_connection(Connection &connection);
+  int parse_input(Connection &connection);
+  int handle_request(Connection &connection);
+  int parse_http(const uint8_t *data, int length);
+  int send_index_html(Connection &connection);
+  int send_gif(Connection &connection);
+  int send_next_image(Connection &connection);
+  bool has_next_image(Connection &connection);
+  uint8_t *find_history(int sequence);
+  OutputQueue::Buffer compress_image(int from, GifCompressor *gif);
+  int send_stream(Connection &connection);
+  int send_frame(Connection &connection);
+  bool wants_frame(Connection &connection);
+  int get_broadcast(Connection &connection);
+  OutputQueue::Buffer get_frame_data(int kind, bool whole);
+  OutputQueue::Buffer compress_frame(
+    int kind,
+    uint8_t *last_frame,
+    GifCompressor *gif,
+    RleCompressor *rle);
+  int send_no_content(Connection &connection);
+  int send_not_modified(Connection &connection);
+  int send_404(Connection &connection);
+  int send_websocket_accept(Connection &connection);
+  int send_websocket_message(
+    Connection &connection,
+    int opcode,
+    const uint8_t *data,
+    int length);
+  int read_websocket(Connection &connection, const uint8_t *data, int length);
+  void set_input_state(int state);
+  void add_key(char key);
+  int queue_send(Connection &connection, const uint8_t *data, int length);
+  bool is_backed_up(Connection &connection);
+  bool drop_frames(Connection &connection);
+
+  static const int MAX_CONNECTIONS = 64;
+
+  // A connection with this many frames or bytes waiting to be sent is
+  // behind, and the frames it hasn't started getting are dropped.
+  static const int MAX_FRAMES = 3;
+  static const int MAX_OUTPUT = 256 * 1024;
+
+  // Frames kept for /image.gif deltas.
+  static const int HISTORY_FRAMES = 8;
+
+  // Quit if there are no requests and no open streams for this long.
+  static const int IDLE_SECONDS = 30;
+
+  // The encoder thread's own compressors, so it can compress a frame
+  // without holding the lock.
+  GifCompressor *encoder_gif;
+  RleCompressor *encoder_rle;
+
+  // Everything below is shared by the encoder and network threads. Only
+  // the encoder thread changes next_frame, history, frame_sequence and
+  // the broadcast frames, so it can read them without the lock.
+  std::mutex lock;
+
+  struct timespec last_active;
+  int refresh_count;
+  int frame_sequence;
+  uint8_t *next_frame;
+  uint8_t *history[HISTORY_FRAMES];
+  int history_sequence[HISTORY_FRAMES];
+  Connection connections[MAX_CONNECTIONS];
+  Broadcast broadcasts[BROADCAST_COUNT];
   GifCompressor *gif_compressor;
+  RleCompressor *rle_compressor;
   char query_string[128];
   char filename[128];
+  char websocket_key[64];
+  char if_none_match[64];
+  char etag[32];
+  char base_path[32];
+  char handoff_path[108];
+  int control_fd;
+  int input_state;
 
-  struct KeyQueue
-  {
-    KeyQueue() : count{0}, head{0}, tail{0}
-    {
-      memset(queue, 0, sizeof(queue));
-    }
-
-    bool is_empty() { return count == 0; }
-    bool is_full() { return count == sizeof(queue); }
-
-    char get_next()
-    {
-      char c = queue[head++];
-      if (head == sizeof(queue)) { head = 0; }
-      count--;
-      return c;
-    }
-
-    void append(char c)
-    {
-      if (is_full()) { return; }
-      queue[tail++] = c;
-      if (tail == sizeof(queue)) { tail = 0; }
-      count++;
-    }
-
-    int count, head, tail;
-    char queue[32];
-  } key_queue;
+  // The last /image.gif, sent again to requests for the same frames.
+  OutputQueue::Buffer image_delta;
+  int image_from;
+  int image_to;
+
+  // The last /frame.gif is sent again without compressing it if the
+  // frame hasn't changed.
+  uint8_t *frame_gif;
+  int frame_gif_length;
+  uint64_t frame_gif_hash;
 };
 
 #endif
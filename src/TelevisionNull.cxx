@@ -15,14 +15,12 @@
 
 #include "TelevisionNull.h"
 
-TelevisionNull::TelevisionNull()
+TelevisionNull::TelevisionNull() : frame_count{0}
 {
-  image = (uint32_t *)malloc(width * height * sizeof(uint32_t));
 }
 
 TelevisionNull::~TelevisionNull()
 {
-  free(image);
 }
 
 int TelevisionNull::init()
@@ -46,6 +44,8 @@ void TelevisionNull::draw_pixel(int x, int y, uint8_t color)
 
 bool TelevisionNull::refresh()
 {
+  frame_count++;
+
   return true;
 }
 
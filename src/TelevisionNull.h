@@ -8,7 +8,9 @@
  * Copyright 2021 by Michael Kohn
  *
  * TelevisionNull is used for debugging. No display is used but text
- * of the system's current state can be dumped to the terminal.
+ * of the system's current state can be dumped to the terminal. It's
+ * also used to run a game with nothing watching, like SnapshotCache
+ * does, which uses get_frame_count() to see where each frame starts.
  *
  */
 
@@ -30,13 +32,11 @@ public:
   //virtual void draw_pixel(int x, int y, uint32_t color);
   //virtual void draw_pixel(int x, int y, uint8_t color);
   virtual bool refresh();
-  virtual void *get_image() { return image; }
-  virtual int get_bitsize() { return 32; }
   virtual int handle_events();
+  int get_frame_count() { return frame_count; }
 
 private:
-  uint32_t *image;
-
+  int frame_count;
 };
 
 #endif
@@ -102,6 +102,8 @@ bool TelevisionSDL::refresh()
   rect.h = height;
 #endif
 
+  expand_frame(image);
+
   // Copy the drawn image to the screen.
   SDL_LockSurface(screen);
   memcpy(screen->pixels, image, width * height * 4);
@@ -31,8 +31,6 @@ public:
   //virtual void draw_pixel(int x, int y, uint8_t color);
   virtual bool refresh();
   virtual int handle_events();
-  virtual void *get_image() { return image; }
-  virtual int get_bitsize() { return 32; }
 
 private:
   SDL_Surface *screen;
@@ -18,11 +18,47 @@
 #include "ColorTable.h"
 #include "TelevisionVNC.h"
 
+// Sent by the server at the start of the handshake, and the one security
+// type it offers (none).
+static const char *protocol_version = "RFB 003.003\n";
+static const uint8_t security[] = { 0, 0, 0, 1 };
+
 TelevisionVNC::TelevisionVNC() :
-  needs_full_image{true},
   needs_color_table{true},
-  image_page{0}
+  image_packet{nullptr, nullptr},
+  image_page{0},
+  diff_buffer{nullptr}
+{
+  for (int n = 0; n < MAX_VIEWERS; n++)
+  {
+    viewers[n].fd = -1;
+    viewers[n].state = VIEWER_VERSION;
+    viewers[n].spectator = false;
+    viewers[n].needs_full_image = true;
+    viewers[n].input_length = 0;
+    viewers[n].input_skip = 0;
+  }
+}
+
+TelevisionVNC::~TelevisionVNC()
+{
+  stop_threads();
+
+  for (int n = 1; n < MAX_VIEWERS; n++)
+  {
+    if (viewers[n].fd != -1) { net_disconnect(viewers[n].fd); }
+  }
+
+  net_close();
+  free(image_packet[0]);
+  free(image_packet[1]);
+  free(diff_buffer);
+}
+
+int TelevisionVNC::init()
 {
+  // The buffers are allocated here since the scale (and with it the
+  // width and height) could be set after the constructor.
   image_packet_length = sizeof(ImagePacket) + (width * height * 4);
   image_packet[0] = (ImagePacket *)malloc(image_packet_length);
   image_packet[1] = (ImagePacket *)malloc(image_packet_length);
@@ -42,17 +78,7 @@ TelevisionVNC::TelevisionVNC() :
 
   diff_buffer_length = width * height * 4;
   diff_buffer = (uint8_t *)malloc(diff_buffer_length);
-}
-
-TelevisionVNC::~TelevisionVNC()
-{
-  net_close();
-  free(image_packet[0]);
-  free(image_packet[1]);
-}
 
-int TelevisionVNC::init()
-{
   if (net_open(port) != 0) { return -1; }
 
   if (send_protocol_version() != 0) { return -1; }
@@ -62,6 +88,14 @@ int TelevisionVNC::init()
   if (send_server_init() != 0) { return -1; }
   //if (send_color_table() != 0) { return -1; }
 
+  // Spectators connect to the same port and get the handshake from the
+  // network thread.
+  if (net_watch(socket_id) != 0) { return -1; }
+
+  add_viewer(client, false);
+
+  start_threads();
+
   return 0;
 }
 
@@ -86,140 +120,410 @@ void TelevisionVNC::draw_pixel(int x, int y, uint8_t color)
 
 bool TelevisionVNC::refresh()
 {
+  // The encoder thread scans it for changes and the network thread
+  // sends them.
+  publish_frame();
   pause();
 
-  send_image_diff();
-
-  image_page ^= 1;
-
   return true;
 }
 
 int TelevisionVNC::handle_events()
 {
-  uint8_t buffer[128];
-  uint32_t key;
-  int n, count;
+  return get_event();
+}
 
-  if (net_has_data())
+void TelevisionVNC::encode_frame(const uint8_t *image)
+{
   {
-    uint8_t message_type = 0xff;
+    std::lock_guard<std::mutex> guard(lock);
 
-    net_recv(&message_type, 1);
+    const bool changed = hash_frame(image);
+    bool needs_full_image = false;
 
-    switch (message_type)
+    for (int n = 0; n < MAX_VIEWERS; n++)
     {
-      case 0:
-        printf("From Client: SetPixelFormat\n");
-        net_recv(buffer + 1, 19);
-        print_pixel_format(buffer);
-        break;
-      case 2:
-        printf("From Client: SetEncodings\n");
-        net_recv(buffer, 3);
-        count = (buffer[1] << 8) | buffer[2];
+      Viewer &viewer = viewers[n];
 
-        for (n = 0; n < count; n++)
-        {
-          net_recv(buffer, 4);
-          print_encoding(buffer);
-        }
-        break;
-      case 3:
-        //printf("From Client: FramebufferUpdateRequest\n");
-        net_recv(buffer + 1, 9);
-        send_image_update(
-          (buffer[2] << 8) | buffer[3],
-          (buffer[4] << 8) | buffer[5],
-          (buffer[6] << 8) | buffer[7],
-          (buffer[8] << 8) | buffer[9],
-          buffer[1]);
-        break;
-      case 4:
-        //printf("From Client: KeyEvent\n");
-        net_recv(buffer + 1, 7);
-        key =
-          (buffer[4] << 24) |
-          (buffer[5] << 16) |
-          (buffer[6] << 8) |
-           buffer[7];
-
-        // If buffer[1] is not 0 then it's a keydown.
-        if (buffer[1] != 0)
+      if (viewer.fd == -1 || viewer.state != VIEWER_READY) { continue; }
+
+      // The viewer can't keep up. The frames it hasn't started getting
+      // are dropped, and since each one was only what changed it gets
+      // the whole frame next.
+      if (is_backed_up(viewer))
+      {
+        viewer.output.drop_frames();
+        viewer.needs_full_image = true;
+      }
+
+      if (viewer.needs_full_image) { needs_full_image = true; }
+    }
+
+    // The last frame sent is still in the other page, so there is nothing
+    // to scan or send if the game drew the same frame again.
+    if (!changed && !needs_full_image) { return; }
+
+    expand_frame(image_packet[image_page]->data, image);
+
+    // Each one is made at most once and shared by every viewer.
+    OutputQueue::Buffer image_full;
+    OutputQueue::Buffer image_diff;
+    bool has_diff = false;
+
+    for (int n = 0; n < MAX_VIEWERS; n++)
+    {
+      Viewer &viewer = viewers[n];
+
+      if (viewer.fd == -1 || viewer.state != VIEWER_READY) { continue; }
+      if (is_backed_up(viewer)) { continue; }
+
+      if (viewer.needs_full_image)
+      {
+        if (image_full == nullptr) { image_full = get_image_full(); }
+
+        viewer.output.push(image_full, true);
+        viewer.needs_full_image = false;
+      }
+        else
+      if (changed)
+      {
+        if (!has_diff)
         {
-          // Escape key quits the game.
-          if (key == 0xff1b) { return KEY_QUIT; }
-
-          // Tab key was pressed.
-          if (key == 0xff09) { return KEY_SELECT_DOWN; }
-          if (key == 0xff0d) { return KEY_RESET_DOWN; }
-          if (key == 0xff51) { return KEY_LEFT_DOWN; }
-          if (key == 0xff54) { return KEY_UP_DOWN; }
-          if (key == 0xff53) { return KEY_RIGHT_DOWN; }
-          if (key == 0xff54) { return KEY_DOWN_DOWN; }
-          if (key == ' ') { return KEY_FIRE_DOWN; }
+          image_diff = get_image_diff();
+          has_diff = true;
         }
-          else
+
+        viewer.output.push(image_diff, true);
+      }
+    }
+
+    image_page ^= 1;
+  }
+
+  net_wake();
+}
+
+void TelevisionVNC::run_network()
+{
+  struct epoll_event ready[MAX_VIEWERS + 2];
+
+  while (running)
+  {
+    const int count = net_wait(ready, MAX_VIEWERS + 2, 100);
+
+    if (count < 0)
+    {
+      quit = true;
+      break;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (int n = 0; n < count; n++)
+    {
+      const int fd = ready[n].data.fd;
+
+      if (fd == socket_id)
+      {
+        int viewer_fd;
+
+        while ((viewer_fd = net_accept()) != -1)
         {
-          // Tab key was released.
-          if (key == 0xff09) { return KEY_SELECT_UP; }
-          if (key == 0xff0d) { return KEY_RESET_UP; }
-          if (key == 0xff51) { return KEY_LEFT_UP; }
-          if (key == 0xff54) { return KEY_UP_UP; }
-          if (key == 0xff53) { return KEY_RIGHT_UP; }
-          if (key == 0xff54) { return KEY_DOWN_UP; }
-          if (key == ' ') { return KEY_FIRE_UP; }
+          add_viewer(viewer_fd, true);
         }
 
-        break;
-      case 5:
-        //printf("From Client: PointerEvent\n");
-        net_recv(buffer + 1, 5);
-        break;
-      case 6:
-        printf("From Client: ClientCutText\n");
-        net_recv(buffer + 1, 7);
-        count =
-          (buffer[4] << 24) |
-          (buffer[5] << 16) |
-          (buffer[6] << 8) |
-           buffer[7];
-        // FIXME: This is not efficient, but don't really expect this one.
-        for (n = 0; n < count; n++) { net_recv(buffer, 1); }
-        break;
+        continue;
+      }
+
+      Viewer *viewer = find_viewer(fd);
+
+      if (viewer == nullptr) { continue; }
+
+      if ((ready[n].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) == 0)
+      {
+        continue;
+      }
+
+      if (read_messages(*viewer) < 0) { remove_viewer(*viewer); }
+    }
+
+    if (quit) { break; }
+
+    // encode_frame() queues frames without an EPOLLOUT coming, so this
+    // tries each time around.
+    for (int n = 0; n < MAX_VIEWERS; n++)
+    {
+      Viewer &viewer = viewers[n];
+
+      if (viewer.fd == -1) { continue; }
+
+      if (net_flush(viewer.fd, viewer.output) < 0) { remove_viewer(viewer); }
+    }
+
+    if (quit) { break; }
+  }
+}
+
+void TelevisionVNC::add_viewer(int fd, bool spectator)
+{
+  for (int n = 0; n < MAX_VIEWERS; n++)
+  {
+    Viewer &viewer = viewers[n];
+
+    if (viewer.fd != -1) { continue; }
+
+    viewer.fd = fd;
+    viewer.spectator = spectator;
+    viewer.needs_full_image = true;
+    viewer.input_length = 0;
+    viewer.input_skip = 0;
+    viewer.output.clear();
+
+    // The player's handshake was done in init(). A spectator's is done
+    // here a message at a time as it comes in.
+    if (spectator)
+    {
+      printf("Spectator connected.\n");
+
+      viewer.state = VIEWER_VERSION;
+      viewer.output.push(
+        (const uint8_t *)protocol_version,
+        strlen(protocol_version));
+    }
+      else
+    {
+      viewer.state = VIEWER_READY;
+    }
+
+    if (net_watch(fd) != 0) { remove_viewer(viewer); }
+
+    return;
+  }
+
+  printf("Too many viewers.\n");
+  net_disconnect(fd);
+}
+
+void TelevisionVNC::remove_viewer(Viewer &viewer)
+{
+  // The game is over when the player leaves.
+  if (!viewer.spectator) { quit = true; }
+
+  net_flush(viewer.fd, viewer.output);
+  net_disconnect(viewer.fd);
+
+  viewer.fd = -1;
+  viewer.input_length = 0;
+  viewer.input_skip = 0;
+  viewer.output.clear();
+}
+
+TelevisionVNC::Viewer *TelevisionVNC::find_viewer(int fd)
+{
+  for (int n = 0; n < MAX_VIEWERS; n++)
+  {
+    if (viewers[n].fd == fd) { return &viewers[n]; }
+  }
+
+  return nullptr;
+}
+
+int TelevisionVNC::read_messages(Viewer &viewer)
+{
+  // The socket is edge triggered, so read until there's nothing left.
+  while (true)
+  {
+    const int space = sizeof(viewer.input) - viewer.input_length;
+
+    int length = net_recv_some(
+      viewer.fd,
+      viewer.input + viewer.input_length,
+      space);
+
+    if (length < 0) { return -1; }
+    if (length == 0) { break; }
+
+    viewer.input_length += length;
+
+    int ptr = 0;
+
+    while (ptr < viewer.input_length)
+    {
+      // The text from a ClientCutText is thrown away as it comes in.
+      if (viewer.input_skip != 0)
+      {
+        const int count = viewer.input_skip < viewer.input_length - ptr ?
+          viewer.input_skip : viewer.input_length - ptr;
+
+        viewer.input_skip -= count;
+        ptr += count;
+        continue;
+      }
+
+      int event;
+      const int count = read_message(
+        viewer,
+        viewer.input + ptr,
+        viewer.input_length - ptr,
+        event);
+
+      if (count < 0) { return -1; }
+      if (count == 0) { break; }
+
+      if (event != 0 && !viewer.spectator) { events.push(event); }
+
+      ptr += count;
     }
+
+    viewer.input_length -= ptr;
+    memmove(viewer.input, viewer.input + ptr, viewer.input_length);
   }
 
   return 0;
 }
 
-void TelevisionVNC::set_pixel(int x, int y, uint32_t color)
+int TelevisionVNC::read_message(
+  Viewer &viewer,
+  const uint8_t *data,
+  int length,
+  int &event)
 {
-  int pixel;
+  // Returns the length of the message at data, 0 if it hasn't all come
+  // in yet, or -1 if it's not a message this knows the length of.
+  uint32_t key;
+  int n, count, size;
+
+  event = 0;
 
-  x = x * 3;
-  y = y * 2;
+  if (viewer.state == VIEWER_VERSION)
+  {
+    if (length < 12) { return 0; }
 
-  if (x < 0 || y < 0) { return; }
+    viewer.output.push(security, sizeof(security));
+    viewer.state = VIEWER_INIT;
 
-  pixel = (y * width) + x;
+    return 12;
+  }
 
-  if (pixel < width * height + width + 1)
+  if (viewer.state == VIEWER_INIT)
   {
-    image_packet[image_page]->data[pixel + 0] = color;
-    image_packet[image_page]->data[pixel + 1] = color;
-    image_packet[image_page]->data[pixel + 2] = color;
-    image_packet[image_page]->data[pixel + width + 0] = color;
-    image_packet[image_page]->data[pixel + width + 1] = color;
-    image_packet[image_page]->data[pixel + width + 2] = color;
+    ServerInit packet;
+
+    make_server_init(packet);
+
+    viewer.output.push((const uint8_t *)&packet, sizeof(packet));
+    viewer.state = VIEWER_READY;
+
+    return 1;
   }
+
+  switch (data[0])
+  {
+    case 0:
+      if (length < 20) { return 0; }
+      printf("From Client: SetPixelFormat\n");
+      print_pixel_format((uint8_t *)data);
+      return 20;
+    case 2:
+      if (length < 4) { return 0; }
+      count = (data[2] << 8) | data[3];
+      size = 4 + (count * 4);
+
+      if (size > (int)sizeof(viewer.input))
+      {
+        printf("Error: Too many encodings (%d).\n", count);
+        return -1;
+      }
+
+      if (length < size) { return 0; }
+
+      printf("From Client: SetEncodings\n");
+
+      for (n = 0; n < count; n++)
+      {
+        print_encoding((uint8_t *)data + 4 + (n * 4));
+      }
+
+      return size;
+    case 3:
+      //printf("From Client: FramebufferUpdateRequest\n");
+      if (length < 10) { return 0; }
+      send_image_update(
+        viewer,
+        (data[2] << 8) | data[3],
+        (data[4] << 8) | data[5],
+        (data[6] << 8) | data[7],
+        (data[8] << 8) | data[9],
+        data[1]);
+      return 10;
+    case 4:
+      //printf("From Client: KeyEvent\n");
+      if (length < 8) { return 0; }
+      key =
+        (data[4] << 24) |
+        (data[5] << 16) |
+        (data[6] << 8) |
+         data[7];
+
+      // If data[1] is not 0 then it's a keydown.
+      event = get_key_event(key, data[1] != 0);
+      return 8;
+    case 5:
+      //printf("From Client: PointerEvent\n");
+      if (length < 6) { return 0; }
+      return 6;
+    case 6:
+      printf("From Client: ClientCutText\n");
+      if (length < 8) { return 0; }
+      viewer.input_skip =
+        (data[4] << 24) |
+        (data[5] << 16) |
+        (data[6] << 8) |
+         data[7];
+      return 8;
+  }
+
+  printf("Error: Unknown message type %d from client.\n", data[0]);
+
+  return -1;
+}
+
+int TelevisionVNC::get_key_event(uint32_t key, bool down)
+{
+  if (down)
+  {
+    // Escape key quits the game.
+    if (key == 0xff1b) { return KEY_QUIT; }
+
+    // Tab key was pressed.
+    if (key == 0xff09) { return KEY_SELECT_DOWN; }
+    if (key == 0xff0d) { return KEY_RESET_DOWN; }
+    if (key == 0xff51) { return KEY_LEFT_DOWN; }
+    if (key == 0xff54) { return KEY_UP_DOWN; }
+    if (key == 0xff53) { return KEY_RIGHT_DOWN; }
+    if (key == 0xff54) { return KEY_DOWN_DOWN; }
+    if (key == ' ') { return KEY_FIRE_DOWN; }
+  }
+    else
+  {
+    // Tab key was released.
+    if (key == 0xff09) { return KEY_SELECT_UP; }
+    if (key == 0xff0d) { return KEY_RESET_UP; }
+    if (key == 0xff51) { return KEY_LEFT_UP; }
+    if (key == 0xff54) { return KEY_UP_UP; }
+    if (key == 0xff53) { return KEY_RIGHT_UP; }
+    if (key == 0xff54) { return KEY_DOWN_UP; }
+    if (key == ' ') { return KEY_FIRE_UP; }
+  }
+
+  return 0;
 }
 
 int TelevisionVNC::send_protocol_version()
 {
-  const char *version = "RFB 003.003\n";
+  const int length = strlen(protocol_version);
 
-  if (net_send((const uint8_t *)version, strlen(version)) != 12)
+  if (net_send((const uint8_t *)protocol_version, length) != 12)
   {
     printf("Couldn't send 12 bytes\n");
     return -1;
@@ -238,7 +542,8 @@ int TelevisionVNC::get_client_protocol_version()
     return -1;
   }
 
-  printf("%s\n", version);
+  // It ends with a newline but isn't 0 terminated.
+  printf("%.*s", (int)sizeof(version), version);
 
   return 0;
 }
@@ -246,7 +551,6 @@ int TelevisionVNC::get_client_protocol_version()
 int TelevisionVNC::send_security()
 {
   // No password.
-  const uint8_t security[] = { 0, 0, 0, 1 };
   //const uint8_t success[] = { 0, 0, 0, 0 };
 
   net_send(security, sizeof(security));
@@ -272,25 +576,27 @@ int TelevisionVNC::get_client_init()
 
 int TelevisionVNC::send_server_init()
 {
-  struct
+  ServerInit packet;
+
+  if (sizeof(packet) != 32)
   {
-    uint16_t width;
-    uint16_t height;
-    uint8_t bits_per_pixel;
-    uint8_t depth;
-    uint8_t big_endian_flag;
-    uint8_t true_colour_flag;
-    uint16_t red_max;
-    uint16_t green_max;
-    uint16_t blue_max;
-    uint8_t red_shift;
-    uint8_t green_shift;
-    uint8_t blue_shift;
-    uint8_t padding[3];
-    uint32_t name_length;
-    char name[8];
-  } packet;
+    printf("Error: Size of packet %s:%d\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  make_server_init(packet);
 
+  if (net_send((const uint8_t *)&packet, sizeof(packet)) != 32)
+  {
+    printf("Error: Send packet %s:%d\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+
+void TelevisionVNC::make_server_init(ServerInit &packet)
+{
   memset(&packet, 0, sizeof(packet));
 
   packet.width = htons(width);
@@ -309,20 +615,6 @@ int TelevisionVNC::send_server_init()
   packet.blue_shift = 0;
   packet.name_length = htonl(8);
   memcpy(packet.name, "ATARI---", 8);
-
-  if (sizeof(packet) != 32)
-  {
-    printf("Error: Size of packet %s:%d\n", __FILE__, __LINE__);
-    exit(1);
-  }
-
-  if (net_send((const uint8_t *)&packet, sizeof(packet)) != 32)
-  {
-    printf("Error: Send packet %s:%d\n", __FILE__, __LINE__);
-    return -1;
-  }
-
-  return 0;
 }
 
 int TelevisionVNC::send_color_table()
@@ -369,22 +661,16 @@ int TelevisionVNC::send_color_table()
   return 0;
 }
 
-int TelevisionVNC::send_image_full()
+OutputQueue::Buffer TelevisionVNC::get_image_full()
 {
   //if (needs_color_table) { return 0; }
 
-  if (net_send((const uint8_t *)image_packet[image_page], image_packet_length) != image_packet_length)
-  {
-    printf("Error: Send packet %s:%d\n", __FILE__, __LINE__);
-    return -1;
-  }
-
-  needs_full_image = false;
-
-  return 0;
+  return OutputQueue::make_buffer(
+    (const uint8_t *)image_packet[image_page],
+    image_packet_length);
 }
 
-int TelevisionVNC::send_image_diff()
+OutputQueue::Buffer TelevisionVNC::get_image_diff()
 {
   int line_mismatch_count = 0;
   int old_page = image_page ^ 1;
@@ -395,12 +681,12 @@ int TelevisionVNC::send_image_diff()
 
   memset(frame_buffer_update, 0, sizeof(FramebufferUpdate));
 
-  for (int y = 0; y < height; y += 2)
+  for (int y = 0; y < height; y += scale_y)
   {
     int line = y * width;
     bool is_mismatch = false;
 
-    for (int x = 0; x < width; x += 3)
+    for (int x = 0; x < width; x += scale_x)
     {
       is_mismatch =
         image_packet[image_page]->data[line + x] !=
@@ -410,7 +696,7 @@ int TelevisionVNC::send_image_diff()
       {
         line_mismatch_count++;
 
-        if (line_mismatch_count > height / 6) { return send_image_full(); }
+        if (line_mismatch_count > height / 6) { return get_image_full(); }
         if (!in_mismatch) { mismatch_start = y; in_mismatch = true; }
 
         break;
@@ -421,7 +707,7 @@ int TelevisionVNC::send_image_diff()
     // no longer in a mismatch.
     if (in_mismatch)
     {
-      if (y == height - 2 || is_mismatch == false)
+      if (y == height - scale_y || is_mismatch == false)
       {
         frame_buffer_update->number_of_rectangles++;
 
@@ -430,7 +716,7 @@ int TelevisionVNC::send_image_diff()
 
         int copy_height = y - mismatch_start;
 
-        if (y == height - 2)
+        if (y == height - scale_y)
         {
           copy_height = height - mismatch_start;
         }
@@ -447,7 +733,7 @@ int TelevisionVNC::send_image_diff()
 
         if (diff_ptr + copy_size > diff_buffer_length)
         {
-          return send_image_full();
+          return get_image_full();
         }
 
         memcpy(
@@ -462,21 +748,16 @@ int TelevisionVNC::send_image_diff()
     }
   }
 
-  if (line_mismatch_count == 0) { return 0; }
+  if (line_mismatch_count == 0) { return nullptr; }
 
   frame_buffer_update->number_of_rectangles =
     htons(frame_buffer_update->number_of_rectangles);
 
-  if (net_send(diff_buffer, diff_ptr) != diff_ptr)
-  {
-    printf("Error: Send packet %s:%d\n", __FILE__, __LINE__);
-    return -1;
-  }
-
-  return 0;
+  return OutputQueue::make_buffer(diff_buffer, diff_ptr);
 }
 
 int TelevisionVNC::send_image_update(
+  Viewer &viewer,
   int x,
   int y,
   int width,
@@ -493,7 +774,7 @@ int TelevisionVNC::send_image_update(
   if (x == 0 && y == 0 && width == this->width && height == this->height)
   {
     if (incremental) { return 0; }
-    needs_full_image = true;
+    viewer.needs_full_image = true;
   }
 
   return 0;
@@ -538,3 +819,10 @@ void TelevisionVNC::print_encoding(uint8_t *buffer)
   }
 }
 
+bool TelevisionVNC::is_backed_up(Viewer &viewer)
+{
+  return
+    viewer.output.get_frames() >= MAX_FRAMES ||
+    viewer.output.get_length() > MAX_OUTPUT;
+}
+
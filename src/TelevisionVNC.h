@@ -11,14 +11,25 @@
  * the VNC remote desktop protocol. Keyboard commands are transmitted
  * back to the class also.
  *
+ * Frames are compared and queued on the encoder thread and the network
+ * thread sends them and reads the viewer's messages from an epoll loop,
+ * so a slow viewer skips frames instead of slowing down the game.
+ *
+ * After the first viewer connects the port keeps listening for up to
+ * MAX_VIEWERS - 1 spectators, which get the same screen but whose keys
+ * are ignored. Each frame update is made once and the same buffer is
+ * queued on every viewer that needs it.
+ *
  */
 
 #ifndef TELEVISION_VNC_H
 #define TELEVISION_VNC_H
 
 #include <stdint.h>
+#include <mutex>
 
 #include "Network.h"
+#include "OutputQueue.h"
 #include "Television.h"
 
 class TelevisionVNC : public Television, public Network
@@ -33,25 +44,91 @@ public:
   //virtual void draw_pixel(int x, int y, uint8_t color);
   virtual bool refresh();
   virtual int handle_events();
-  virtual void *get_image() { return image_packet[image_page]->data; }
-  virtual int get_bitsize() { return 32; }
   virtual void set_port(int value) { port = value; };
 
+protected:
+  virtual void encode_frame(const uint8_t *image);
+  virtual void run_network();
+
 private:
-  inline void set_pixel(int x, int y, uint32_t color);
+  struct Viewer
+  {
+    int fd;
+    int state;
+
+    // Keys from a spectator are ignored.
+    bool spectator;
+
+    // The last frame update wasn't sent to it.
+    bool needs_full_image;
+
+    // Messages from the viewer that haven't all come in yet.
+    uint8_t input[4096];
+    int input_length;
+    int input_skip;
+
+    // Data the network thread hasn't been able to send yet.
+    OutputQueue output;
+  };
+
+  // How far a viewer is through the handshake.
+  enum
+  {
+    VIEWER_VERSION,
+    VIEWER_INIT,
+    VIEWER_READY,
+  };
+
+  struct ServerInit
+  {
+    uint16_t width;
+    uint16_t height;
+    uint8_t bits_per_pixel;
+    uint8_t depth;
+    uint8_t big_endian_flag;
+    uint8_t true_colour_flag;
+    uint16_t red_max;
+    uint16_t green_max;
+    uint16_t blue_max;
+    uint8_t red_shift;
+    uint8_t green_shift;
+    uint8_t blue_shift;
+    uint8_t padding[3];
+    uint32_t name_length;
+    char name[8];
+  };
+
+  void add_viewer(int fd, bool spectator);
+  void remove_viewer(Viewer &viewer);
+  Viewer *find_viewer(int fd);
+  int read_messages(Viewer &viewer);
+  int read_message(
+    Viewer &viewer,
+    const uint8_t *data,
+    int length,
+    int &event);
+  int get_key_event(uint32_t key, bool down);
+  bool is_backed_up(Viewer &viewer);
+
   int send_protocol_version();
   int get_client_protocol_version();
   int send_security();
   int get_client_init();
   int send_server_init();
+  void make_server_init(ServerInit &packet);
   int send_color_table();
-  int send_image_full();
-  int send_image_diff();
-  int send_image_update(int x, int y, int width, int height, bool incremental);
+  OutputQueue::Buffer get_image_full();
+  OutputQueue::Buffer get_image_diff();
+  int send_image_update(
+    Viewer &viewer,
+    int x,
+    int y,
+    int width,
+    int height,
+    bool incremental);
   void print_pixel_format(uint8_t *buffer);
   void print_encoding(uint8_t *buffer);
 
-  bool needs_full_image;
   bool needs_color_table;
   int image_packet_length;
 
@@ -89,6 +166,19 @@ private:
   uint8_t *diff_buffer;
   int diff_buffer_length;
 
+  // The first one is the viewer that plays, from net_open().
+  static const int MAX_VIEWERS = 16;
+
+  // With this many frames or bytes waiting to be sent, the frames that
+  // haven't started going out are dropped.
+  static const int MAX_FRAMES = 3;
+  static const int MAX_OUTPUT = 1024 * 1024;
+
+  // Guards the viewers and image pages shared by the encoder and
+  // network threads.
+  std::mutex lock;
+  Viewer viewers[MAX_VIEWERS];
+
   enum
   {
     ENCODING_RAW = 0,
@@ -0,0 +1,98 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "TripleBuffer.h"
+
+TripleBuffer::TripleBuffer(int length) :
+  middle{1},
+  back{0},
+  front{2}
+{
+  for (int n = 0; n < 3; n++)
+  {
+    buffers[n] = (uint8_t *)malloc(length);
+    memset(buffers[n], 0, length);
+  }
+}
+
+TripleBuffer::~TripleBuffer()
+{
+  for (int n = 0; n < 3; n++)
+  {
+    free(buffers[n]);
+  }
+}
+
+void TripleBuffer::publish()
+{
+  back =
+    middle.exchange(back | NEW_FRAME, std::memory_order_acq_rel) &
+    INDEX_MASK;
+
+  wake();
+}
+
+bool TripleBuffer::wait(int timeout_ms)
+{
+  const int value = middle.load(std::memory_order_acquire);
+
+  if ((value & NEW_FRAME) != 0) { return true; }
+
+  struct timespec timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+  // Only sleeps if middle still has the value just read, so a frame
+  // published in between isn't missed.
+  syscall(
+    SYS_futex,
+    (int *)&middle,
+    FUTEX_WAIT_PRIVATE,
+    value,
+    &timeout,
+    nullptr,
+    0);
+
+  return (middle.load(std::memory_order_acquire) & NEW_FRAME) != 0;
+}
+
+bool TripleBuffer::take()
+{
+  if ((middle.load(std::memory_order_acquire) & NEW_FRAME) == 0)
+  {
+    return false;
+  }
+
+  front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+
+  return true;
+}
+
+void TripleBuffer::wake()
+{
+  syscall(
+    SYS_futex,
+    (int *)&middle,
+    FUTEX_WAKE_PRIVATE,
+    1,
+    nullptr,
+    nullptr,
+    0);
+}
+
@@ -0,0 +1,57 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * TripleBuffer passes frames from the emulator thread to an encoder
+ * thread without either one waiting on the other. The emulator draws
+ * into the back buffer and publish() swaps it with the middle one. The
+ * encoder's take() swaps the middle one with the front if there is a
+ * new frame. If the encoder is slow, frames in between are dropped.
+ *
+ * The middle buffer's index and a new frame flag are in one atomic int
+ * so each swap is a single exchange. wait() sleeps on it with a futex,
+ * so publish() never takes a lock.
+ *
+ */
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+class TripleBuffer
+{
+public:
+  TripleBuffer(int length);
+  ~TripleBuffer();
+
+  // Emulator thread.
+  uint8_t *get_back() { return buffers[back]; }
+  void publish();
+
+  // Encoder thread. wait() returns true if take() has a new frame.
+  bool wait(int timeout_ms);
+  bool take();
+  uint8_t *get_front() { return buffers[front]; }
+
+  // Wakes up wait() without a new frame.
+  void wake();
+
+private:
+  static const int NEW_FRAME = 4;
+  static const int INDEX_MASK = 3;
+
+  uint8_t *buffers[3];
+  std::atomic<int> middle;
+  int back;
+  int front;
+};
+
+#endif
+
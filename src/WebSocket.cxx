@@ -0,0 +1,237 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "WebSocket.h"
+
+void WebSocket::get_accept_key(char *accept, const char *key)
+{
+  const char *guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  uint8_t text[128];
+  uint8_t digest[20];
+  int length = strlen(key);
+
+  if (length > 64) { length = 64; }
+
+  memcpy(text, key, length);
+  memcpy(text + length, guid, 36);
+
+  sha1(digest, text, length + 36);
+  base64(accept, digest, sizeof(digest));
+}
+
+int WebSocket::make_header(uint8_t *header, int opcode, int length)
+{
+  // Server messages are always sent whole and not masked.
+  header[0] = 0x80 | opcode;
+
+  if (length < 126)
+  {
+    header[1] = length;
+    return 2;
+  }
+
+  if (length < 65536)
+  {
+    header[1] = 126;
+    header[2] = length >> 8;
+    header[3] = length & 0xff;
+    return 4;
+  }
+
+  header[1] = 127;
+
+  for (int n = 0; n < 8; n++)
+  {
+    header[2 + n] = n < 4 ? 0 : (length >> ((7 - n) * 8)) & 0xff;
+  }
+
+  return 10;
+}
+
+int WebSocket::parse(
+  const uint8_t *data,
+  int length,
+  int &opcode,
+  uint8_t *payload,
+  int &payload_length,
+  int max_payload)
+{
+  if (length < 2) { return 0; }
+
+  int ptr = 2;
+
+  opcode = data[0] & 0x0f;
+  payload_length = data[1] & 0x7f;
+
+  if (payload_length == 126)
+  {
+    if (length < 4) { return 0; }
+    payload_length = (data[2] << 8) | data[3];
+    ptr = 4;
+  }
+    else
+  if (payload_length == 127)
+  {
+    // Nothing the page sends is anywhere near this big.
+    return -1;
+  }
+
+  if (payload_length > max_payload) { return -1; }
+
+  // Messages from the browser are always masked.
+  const bool masked = (data[1] & 0x80) != 0;
+  const uint8_t *mask = data + ptr;
+
+  if (masked) { ptr += 4; }
+
+  if (length < ptr + payload_length) { return 0; }
+
+  for (int n = 0; n < payload_length; n++)
+  {
+    payload[n] = data[ptr + n] ^ (masked ? mask[n & 3] : 0);
+  }
+
+  return ptr + payload_length;
+}
+
+void WebSocket::sha1(uint8_t *digest, const uint8_t *data, int length)
+{
+  uint32_t h[5] =
+  {
+    0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+  };
+  uint8_t block[64];
+  uint32_t w[80];
+  int ptr = 0;
+  bool done = false;
+  bool end_marked = false;
+
+  while (!done)
+  {
+    // Copy the next 64 bytes with the 0x80 end marker and the length in
+    // bits in the last 8 bytes of the last block.
+    int count = length - ptr;
+
+    if (count > 64) { count = 64; }
+    if (count < 0) { count = 0; }
+
+    memset(block, 0, sizeof(block));
+    memcpy(block, data + ptr, count);
+    ptr += count;
+
+    if (count < 64 && !end_marked)
+    {
+      block[count] = 0x80;
+      end_marked = true;
+      count++;
+    }
+
+    if (end_marked && count <= 56)
+    {
+      const uint64_t bits = (uint64_t)length * 8;
+
+      for (int n = 0; n < 8; n++)
+      {
+        block[63 - n] = (bits >> (n * 8)) & 0xff;
+      }
+
+      done = true;
+    }
+
+    for (int n = 0; n < 16; n++)
+    {
+      w[n] =
+        ((uint32_t)block[n * 4 + 0] << 24) |
+        ((uint32_t)block[n * 4 + 1] << 16) |
+        ((uint32_t)block[n * 4 + 2] << 8) |
+         (uint32_t)block[n * 4 + 3];
+    }
+
+    for (int n = 16; n < 80; n++)
+    {
+      w[n] = rotate(w[n - 3] ^ w[n - 8] ^ w[n - 14] ^ w[n - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (int n = 0; n < 80; n++)
+    {
+      uint32_t f, k;
+
+      if (n < 20)
+      {
+        f = (b & c) | (~b & d);
+        k = 0x5a827999;
+      }
+        else
+      if (n < 40)
+      {
+        f = b ^ c ^ d;
+        k = 0x6ed9eba1;
+      }
+        else
+      if (n < 60)
+      {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8f1bbcdc;
+      }
+        else
+      {
+        f = b ^ c ^ d;
+        k = 0xca62c1d6;
+      }
+
+      uint32_t temp = rotate(a, 5) + f + e + k + w[n];
+      e = d;
+      d = c;
+      c = rotate(b, 30);
+      b = a;
+      a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int n = 0; n < 20; n++)
+  {
+    digest[n] = (h[n / 4] >> (24 - ((n & 3) * 8))) & 0xff;
+  }
+}
+
+void WebSocket::base64(char *text, const uint8_t *data, int length)
+{
+  const char *digits =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  for (int n = 0; n < length; n += 3)
+  {
+    uint32_t value = data[n] << 16;
+
+    if (n + 1 < length) { value |= data[n + 1] << 8; }
+    if (n + 2 < length) { value |= data[n + 2]; }
+
+    *text++ = digits[(value >> 18) & 0x3f];
+    *text++ = digits[(value >> 12) & 0x3f];
+    *text++ = n + 1 < length ? digits[(value >> 6) & 0x3f] : '=';
+    *text++ = n + 2 < length ? digits[value & 0x3f] : '=';
+  }
+
+  *text = 0;
+}
+
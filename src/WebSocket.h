@@ -0,0 +1,65 @@
+/**
+ *  Cloudtari
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2021 by Michael Kohn
+ *
+ * WebSocket has the parts of RFC 6455 that TelevisionHttp needs: the
+ * Sec-WebSocket-Accept value for the handshake, and building and
+ * parsing message headers. SHA-1 and base64 are only used for the
+ * handshake so they are done here instead of pulling in a library.
+ *
+ */
+
+#ifndef WEB_SOCKET_H
+#define WEB_SOCKET_H
+
+#include <stdint.h>
+
+class WebSocket
+{
+public:
+  // accept must have room for 29 bytes.
+  static void get_accept_key(char *accept, const char *key);
+
+  // Returns the header length. header must have room for 10 bytes.
+  static int make_header(uint8_t *header, int opcode, int length);
+
+  // Unmasks one client message from data into payload. Returns the
+  // number of bytes used, 0 if data doesn't have the whole message yet,
+  // or -1 if the message is bigger than max_payload.
+  static int parse(
+    const uint8_t *data,
+    int length,
+    int &opcode,
+    uint8_t *payload,
+    int &payload_length,
+    int max_payload);
+
+  enum
+  {
+    OPCODE_TEXT = 1,
+    OPCODE_BINARY = 2,
+    OPCODE_CLOSE = 8,
+    OPCODE_PING = 9,
+    OPCODE_PONG = 10,
+  };
+
+private:
+  WebSocket() { }
+  ~WebSocket() { }
+
+  static void sha1(uint8_t *digest, const uint8_t *data, int length);
+  static void base64(char *text, const uint8_t *data, int length);
+
+  static uint32_t rotate(uint32_t value, int bits)
+  {
+    return (value << bits) | (value >> (32 - bits));
+  }
+};
+
+#endif
+
@@ -12,11 +12,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <thread>
 
+#include "Benchmark.h"
 #include "DebugTimer.h"
+#include "FrontDoor.h"
 #include "M6502.h"
 #include "MemoryBus.h"
+#include "ProcessPool.h"
 #include "ROM.h"
+#include "SessionServer.h"
+#include "SnapshotCache.h"
 #include "TelevisionHttp.h"
 #include "TelevisionNull.h"
 #ifdef USE_SDL
@@ -32,44 +38,174 @@ int main(int argc, char *argv[])
   bool step = false;
   int step_address = -1;
   int port = 5900;
-  Television *television;
+  int benchmark_seconds = 0;
+  const char *filename = argv[1];
+  char pooled_filename[256];
+  Television *television = nullptr;
 
   // Used to see how many CPU cycles a set of instructions takes.
   DebugTimer debug_timer;
 
+  bool reference = false;
+
+  // Games someone plays start from where they first read input.
+  bool snapshot = false;
+
   if (argc < 3 || argc > 5)
   {
     printf(
-      "Usage: %s <gamefile.bin> <null/sdl/vnc/debug/break/timer/step>\n"
+      "Usage: %s <gamefile.bin> <null/reference/sdl/vnc/debug/break/timer/step/benchmark>\n"
       "          null\n"
+      "          reference\n"
 #ifdef USE_SDL
       "          sdl\n"
 #endif
-      "          vnc <port>\n"
-      "          http <port>\n"
+      "          vnc <port> <scale 1-3>\n"
+      "          http <port or socket directory/name.sock>\n"
       "          debug\n"
       "          break <address>\n"
       "          timer <start_address> <end_address>\n"
-      "          step <start_address>\n",
+      "          step <start_address>\n"
+      "          benchmark <seconds>\n"
+      "          server <port> <threads> (gamefile is the ROM directory)\n"
+      "          frontdoor <port> (gamefile is the socket directory)\n"
+      "          pool <port> <ready> (gamefile is the ROM directory)\n",
       argv[0]);
     exit(0);
   }
 
+  // Runs a game for each browser that asks for one, all in this process.
+  if (strcmp(argv[2], "server") == 0)
+  {
+    SessionServer *server = new SessionServer();
+    int threads = std::thread::hardware_concurrency();
+
+    // It runs until it's killed, so the log has to go out a line at a
+    // time even when it's a file.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    port = 8080;
+    if (argc > 3) { port = atoi(argv[3]); }
+    if (argc > 4) { threads = atoi(argv[4]); }
+
+    if (server->init(argv[1], port, threads) != 0)
+    {
+      delete server;
+
+      printf("Server init error.\n");
+      return -1;
+    }
+
+    server->run();
+
+    delete server;
+
+    return 0;
+  }
+
+  // Passes connections on to the games listening in a directory.
+  if (strcmp(argv[2], "frontdoor") == 0)
+  {
+    FrontDoor *front_door = new FrontDoor();
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    port = 8080;
+    if (argc > 3) { port = atoi(argv[3]); }
+
+    if (front_door->init(argv[1], port) != 0)
+    {
+      delete front_door;
+
+      printf("Front door init error.\n");
+      return -1;
+    }
+
+    front_door->run();
+
+    delete front_door;
+
+    return 0;
+  }
+
+  // Starts games in processes it keeps ready ahead of time.
+  if (strcmp(argv[2], "pool") == 0)
+  {
+    ProcessPool *pool = new ProcessPool();
+    int ready = 4;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    port = 8080;
+    if (argc > 3) { port = atoi(argv[3]); }
+    if (argc > 4) { ready = atoi(argv[4]); }
+
+    if (pool->init(argv[1], port, ready) != 0)
+    {
+      delete pool;
+
+      printf("Pool init error.\n");
+      return -1;
+    }
+
+    pool->run();
+
+    delete pool;
+
+    return 0;
+  }
+
   M6502 *m6502 = new M6502();
   MemoryBus *memory_bus = new MemoryBus();
   ROM *rom = new ROM();
 
-  if (rom->load(argv[1]) != 0) { exit(-1); }
+  // One of the ProcessPool's processes. Everything that doesn't need the
+  // ROM is done before it waits to be given one.
+  if (strcmp(argv[2], "pooled") == 0)
+  {
+    TelevisionHttp *television_http = new TelevisionHttp();
+    const int control = argc > 3 ? atoi(argv[3]) : -1;
+    char rom_name[128];
+    char path[32];
+    int id;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (ProcessPool::wait_for_game(
+          control, rom_name, sizeof(rom_name), &id) != 0)
+    {
+      exit(0);
+    }
+
+    snprintf(pooled_filename, sizeof(pooled_filename), "%s/%s",
+      argv[1], rom_name);
+    snprintf(path, sizeof(path), "/%d", id);
+
+    television_http->set_control_socket(control);
+    television_http->set_base_path(path);
+
+    television = television_http;
+    filename = pooled_filename;
+  }
+
+  if (rom->load(filename) != 0) { exit(-1); }
 
   memory_bus->init();
   memory_bus->set_rom(rom);
   m6502->set_memory_bus(memory_bus);
   m6502->reset();
 
+  if (television != nullptr)
+  {
+    // A pooled TelevisionHttp, made before the ROM was loaded.
+    snapshot = true;
+  }
+    else
 #ifdef USE_SDL
   if (strcmp(argv[2], "sdl") == 0)
   {
     television = new TelevisionSDL();
+    snapshot = true;
   }
     else
 #endif
@@ -79,17 +215,44 @@ int main(int argc, char *argv[])
 
     if (argc > 3) { port = atoi(argv[3]); }
 
+    // Each pixel is 3x2 by default, 2x2 and 1x1 are smaller.
+    if (argc > 4)
+    {
+      const int scale = atoi(argv[4]);
+
+      if (scale < 1 || scale > 3)
+      {
+        printf("Error: Scale must be 1 to 3.\n");
+        exit(1);
+      }
+
+      television->set_scale(scale, scale == 1 ? 1 : 2);
+    }
+
     television->set_port(port);
+    snapshot = true;
   }
     else
   if (strcmp(argv[2], "http") == 0)
   {
-    television = new TelevisionHttp();
+    TelevisionHttp *television_http = new TelevisionHttp();
 
     port = 8080;
-    if (argc > 3) { port = atoi(argv[3]); }
 
-    television->set_port(port);
+    // A path is a Unix socket a FrontDoor passes the connections to.
+    if (argc > 3 && strchr(argv[3], '/') != NULL)
+    {
+      television_http->set_socket_path(argv[3]);
+    }
+      else
+    if (argc > 3)
+    {
+      port = atoi(argv[3]);
+    }
+
+    television_http->set_port(port);
+    television = television_http;
+    snapshot = true;
   }
     else
   if (strcmp(argv[2], "debug") == 0)
@@ -138,6 +301,22 @@ int main(int argc, char *argv[])
     television = new TelevisionNull();
   }
     else
+  if (strcmp(argv[2], "reference") == 0)
+  {
+    // Same as null, but the TIA draws one pixel at a time. Used to check
+    // the faster renderer against.
+    television = new TelevisionNull();
+    reference = true;
+  }
+    else
+  if (strcmp(argv[2], "benchmark") == 0)
+  {
+    television = new TelevisionNull();
+
+    benchmark_seconds = 5;
+    if (argc > 3) { benchmark_seconds = atoi(argv[3]); }
+  }
+    else
   {
     printf("Unknown mode %s\n", argv[2]);
     exit(1);
@@ -154,9 +333,26 @@ int main(int argc, char *argv[])
     return -1;
   }
 
-  RIOT *riot = memory_bus->get_riot();
   TIA *tia = memory_bus->get_tia();
   tia->set_television(television);
+  tia->set_reference_renderer(reference);
+
+  if (snapshot) { SnapshotCache::boot(m6502, memory_bus); }
+
+  if (benchmark_seconds != 0)
+  {
+    Benchmark::run_reference(m6502, memory_bus, benchmark_seconds);
+
+    m6502->reset();
+    Benchmark::run_machine(m6502, memory_bus, benchmark_seconds);
+    Benchmark::run_save_state(m6502, memory_bus, 1);
+    Benchmark::run_clones(filename, 1);
+    Benchmark::run_scale(1);
+    Benchmark::run_hash(1);
+    Benchmark::run_gif(television, 1);
+
+    m6502->stop();
+  }
 
   // memory_bus->dump(0xf000, 0xffff);
 
@@ -167,32 +363,21 @@ int main(int argc, char *argv[])
       step = true;
     }
 
-    if (tia->wait_for_hsync())
-    {
-      cycles = 1;
-      m6502->clock();
-    }
-      else
-    {
-      //int address = m6502->get_pc();
-      cycles = m6502->step();
-      //debug_timer.compute(address, cycles);
-    }
-
-    memory_bus->clock(cycles);
+    //int address = m6502->get_pc();
+    cycles = debug ? m6502->step_debug() : m6502->step();
+    //debug_timer.compute(address, cycles);
 
     if (debug)
     {
+      memory_bus->sync(m6502->get_total_cycles());
+
       printf("  cycles=%d\n", cycles);
       m6502->dump();
       tia->dump();
       memory_bus->dump(0x80, 0xff);
 
-      if (!tia->wait_for_hsync())
-      {
-        //sleep(1);
-        usleep(1000);
-      }
+      //sleep(1);
+      usleep(1000);
     }
 
     if (tia->need_check_events())
@@ -201,51 +386,7 @@ int main(int argc, char *argv[])
 
       if (event_code == Television::KEY_QUIT) { break; }
 
-      switch (event_code)
-      {
-        case Television::KEY_SELECT_DOWN:
-          riot->set_switch_select();
-          break;
-        case Television::KEY_SELECT_UP:
-          riot->clear_switch_select();
-          break;
-        case Television::KEY_RESET_DOWN:
-          riot->set_switch_reset();
-          break;
-        case Television::KEY_RESET_UP:
-          riot->clear_switch_reset();
-          break;
-        case Television::KEY_LEFT_DOWN:
-          riot->set_joystick_0_left();
-          break;
-        case Television::KEY_LEFT_UP:
-          riot->clear_joystick_0_left();
-          break;
-        case Television::KEY_RIGHT_DOWN:
-          riot->set_joystick_0_right();
-          break;
-        case Television::KEY_RIGHT_UP:
-          riot->clear_joystick_0_right();
-          break;
-        case Television::KEY_UP_DOWN:
-          riot->set_joystick_0_up();
-          break;
-        case Television::KEY_UP_UP:
-          riot->clear_joystick_0_up();
-          break;
-        case Television::KEY_DOWN_DOWN:
-          riot->set_joystick_0_down();
-          break;
-        case Television::KEY_DOWN_UP:
-          riot->clear_joystick_0_down();
-          break;
-        case Television::KEY_FIRE_DOWN:
-          tia->set_joystick_0_fire();
-          break;
-        case Television::KEY_FIRE_UP:
-          tia->clear_joystick_0_fire();
-          break;
-      }
+      memory_bus->handle_event(event_code);
     }
 
     if (step)
@@ -254,6 +395,9 @@ int main(int argc, char *argv[])
     }
   }
 
+  m6502->dump_cache_stats();
+  television->get_pacer()->print_stats();
+
 #if 0
    m6502->dump();
    tia->dump();